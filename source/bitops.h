@@ -8,13 +8,27 @@
 #define MBITS32( c, l, r )	( RBITS32( c,l ) >> r )
 #define BITN( c, n )		( (c >> n) & 0x1 )
 
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <memory>
+#include <utility>
 #include <vector>
 
 enum StreamType {
 	kFile = 0,
 	kMemory = 1,
-	kStream = 2
+	kStream = 2,
+	kMapped = 3, // memory mapped file, plain file where mapping is not available
+	kCallback = 4 // user supplied read/write functions, source points to StreamCallbacks
+};
+
+// read returns the number of bytes read, 0 at the end of the data,
+// write returns the number of bytes written, anything short is an error
+struct StreamCallbacks {
+	std::size_t ( *read )( void* opaque, unsigned char* buf, std::size_t size );
+	std::size_t ( *write )( void* opaque, const unsigned char* buf, std::size_t size );
+	void* opaque;
 };
 
 enum StreamMode {
@@ -30,22 +44,22 @@ enum StreamMode {
 class abitreader
 {
 public:
-	abitreader( unsigned char* array, int size );
+	abitreader( unsigned char* array, std::size_t size );
 	~abitreader();	
 	unsigned int read( int nbits );
 	unsigned char read_bit();
 	unsigned char unpad( unsigned char fillbit );
-	int getpos();
+	std::size_t getpos();
 	int getbitp();
-	void setpos( int pbyte, int pbit );
+	void setpos( std::size_t pbyte, int pbit );
 	void rewind_bits( int nbits );
 	bool eof();
 	int peof();
 	
 private:
 	unsigned char* data;
-	int lbyte;
-	int cbyte;
+	std::size_t lbyte;
+	std::size_t cbyte;
 	int cbit;
 	int peof_;
 	bool eof_;
@@ -59,27 +73,97 @@ private:
 class abitwriter
 {
 public:
-	abitwriter( int size );
+	abitwriter( std::size_t size );
 	~abitwriter();	
 	void write( unsigned int val, int nbits );
 	void write_bit( unsigned char bit );
 	void set_fillbit( unsigned char fillbit );
+	void set_stuffing( bool stuffing );
 	void pad();
+	void write_marker( unsigned char marker );
+	template <class F> void for_each_chunk( F f );
+	template <class F> void drain( F f );
 	unsigned char* getptr();
-	int getpos();
+	std::size_t getpos();
 	int getbitp();
 	bool error();
 	
 private:
+	void flush_word();
+	void flush_bytes();
+	bool grow( std::size_t min_size );
+	
 	unsigned char fillbit_;
+	bool stuffing_; // JPEG style 0xFF 0x00 byte stuffing on/off
+	std::vector<std::pair<unsigned char*, std::size_t>> chunks; // completed blocks and their sizes
+	std::size_t chunked; // number of bytes in completed blocks
+	std::size_t drained; // number of bytes already handed out by drain()
 	unsigned char* data;
-	int dsize;
-	int cbyte;
-	int cbit;
+	std::size_t dsize;
+	std::size_t cbyte;
+	std::uint64_t buf_; // bit accumulator, lowest bits_ bits are pending
+	int bits_;
 	bool fmem;
 	bool error_;
 };
 
+/* -----------------------------------------------
+	writes n (0...32) bits to abitwriter, bits are
+	collected in the accumulator and stored wordwise
+	----------------------------------------------- */
+
+inline void abitwriter::write( unsigned int val, int nbits )
+{
+	if ( nbits <= 0 ) return;
+	buf_ = ( buf_ << nbits ) | ( val & ( 0xFFFFFFFFu >> ( 32 - nbits ) ) );
+	bits_ += nbits;
+	if ( bits_ >= 32 ) flush_word();
+}
+
+/* -----------------------------------------------
+	writes one bit to abitwriter
+	----------------------------------------------- */
+
+inline void abitwriter::write_bit( unsigned char bit )
+{
+	buf_ = ( buf_ << 1 ) | ( ( bit ) ? 1 : 0 );
+	if ( ++bits_ >= 32 ) flush_word();
+}
+
+/* -----------------------------------------------
+	pads data and calls f( ptr, size ) for each
+	block of data, in order, without copying
+	----------------------------------------------- */
+
+template <class F> void abitwriter::for_each_chunk( F f )
+{
+	pad();
+	flush_bytes();
+	if ( error() ) return;
+	for ( const auto& chunk : chunks ) f( chunk.first, chunk.second );
+	f( data, cbyte );
+}
+
+/* -----------------------------------------------
+	hands all complete bytes to f( ptr, size ) and
+	discards them, positions keep counting on
+	----------------------------------------------- */
+
+template <class F> void abitwriter::drain( F f )
+{
+	flush_bytes();
+	if ( error() ) return;
+	for ( const auto& chunk : chunks ) {
+		f( chunk.first, chunk.second );
+		free( chunk.first );
+	}
+	if ( cbyte > 0 ) f( data, cbyte );
+	drained += chunked + cbyte;
+	chunks.clear();
+	chunked = 0;
+	cbyte = 0;
+}
+
 
 /* -----------------------------------------------
 	class to read arrays bytewise
@@ -88,19 +172,19 @@ private:
 class abytereader
 {
 public:
-	abytereader( unsigned char* array, int size );
+	abytereader( unsigned char* array, std::size_t size );
 	~abytereader();	
 	int read( unsigned char* byte );
-	int read_n( unsigned char* byte, int n );
-	void seek( int pos );
-	int getsize();
-	int getpos();
+	std::size_t read_n( unsigned char* byte, std::size_t n );
+	void seek( std::size_t pos );
+	std::size_t getsize();
+	std::size_t getpos();
 	bool eof();
 	
 private:
 	unsigned char* data;
-	int lbyte;
-	int cbyte;
+	std::size_t lbyte;
+	std::size_t cbyte;
 	bool _eof;
 };
 
@@ -112,25 +196,44 @@ private:
 class abytewriter
 {
 public:
-	abytewriter( int size );
+	abytewriter( std::size_t size );
 	~abytewriter();	
 	void write( unsigned char byte );
-	void write_n(const unsigned char* byte, int n );
+	void write_n(const unsigned char* byte, std::size_t n );
+	void reserve( std::size_t size );
+	template <class F> void for_each_chunk( F f ) const;
 	unsigned char* getptr();
 	unsigned char* peekptr();
-	int getpos();
+	std::size_t getpos();
 	void reset();
 	bool error();
 	
 private:
+	bool grow( std::size_t min_size );
+	
+	std::vector<std::pair<unsigned char*, std::size_t>> chunks; // completed blocks and their sizes
+	std::size_t chunked; // number of bytes in completed blocks
 	unsigned char* data;
-	int dsize;
-	int cbyte;
+	std::size_t dsize;
+	std::size_t cbyte;
 	bool fmem;
 	bool _error;
 };
 
 
+/* -----------------------------------------------
+	calls f( ptr, size ) for each block of data,
+	in order, without copying
+	----------------------------------------------- */
+
+template <class F> void abytewriter::for_each_chunk( F f ) const
+{
+	if ( _error ) return;
+	for ( const auto& chunk : chunks ) f( chunk.first, chunk.second );
+	f( data, cbyte );
+}
+
+
 /* -----------------------------------------------
 	class for input and output from file or memory
 	----------------------------------------------- */
@@ -138,18 +241,25 @@ private:
 class iostream
 {
 public:
-	iostream( void* src, StreamType srctype, int srcsize, StreamMode iomode );
+	iostream( void* src, StreamType srctype, std::size_t srcsize, StreamMode iomode );
 	~iostream();
 	void switch_mode();
-	int read(unsigned char* to, int dtsize);
+	void retain();
+	std::size_t read(unsigned char* to, std::size_t dtsize);
 	bool read_byte(unsigned char* to);
-	int write(const unsigned char* from, int dtsize);
+	std::size_t write(const unsigned char* from, std::size_t dtsize);
 	int write_byte(unsigned char byte);
-	int flush();
-	int rewind();
-	int getpos();
-	int getsize();
+	void reserve(std::size_t size);
+	std::size_t flush();
+	std::size_t rewind();
+	std::size_t getpos();
+	std::size_t getsize();
+	std::size_t getread();
+	bool inmemory();
+	std::size_t memsize();
 	unsigned char* getptr();
+	unsigned char* detach(std::size_t* size);
+	std::size_t prefetch(std::size_t limit);
 	bool chkerr();
 	bool chkeof();
 	
@@ -157,15 +267,27 @@ private:
 	void open_file();
 	void open_mem();
 	void open_stream();
+	bool piped() const;
+	bool refill_stream();
+	std::size_t pull_data(unsigned char* to, std::size_t size);
+	void push_stream(const unsigned char* from, std::size_t size);
+	void flush_stream();
+	void open_map();
+	void close_map();
+	bool grow_map( std::size_t min_size, bool exact );
 	
-	int write_file(const unsigned char* from, int dtsize);
+	std::size_t write_file(const unsigned char* from, std::size_t dtsize);
 	int write_file_byte(unsigned char byte);
-	int read_file(unsigned char* to, int dtsize);
+	std::size_t read_file(unsigned char* to, std::size_t dtsize);
 	bool read_file_byte(unsigned char* to);
-	int write_mem(const unsigned char* from, int dtsize );
+	std::size_t write_mem(const unsigned char* from, std::size_t dtsize );
 	int write_mem_byte(unsigned char byte);
-	int read_mem(unsigned char* to, int dtsize);
+	std::size_t read_mem(unsigned char* to, std::size_t dtsize);
 	bool read_mem_byte(unsigned char* to);
+	std::size_t write_map(const unsigned char* from, std::size_t dtsize );
+	int write_map_byte(unsigned char byte);
+	std::size_t read_stream(unsigned char* to, std::size_t dtsize);
+	bool read_stream_byte(unsigned char* to);
 	
 	FILE* fptr;
 	std::vector<char> file_buffer; // Used to replace the default file buffer for reads/writes to improve performance.
@@ -173,11 +295,29 @@ private:
 	std::unique_ptr<abytewriter> mwrt;
 	std::unique_ptr<abytereader> mrdr;
 	
+	int fd; // descriptor of mapped file
+	unsigned char* map; // mapped file data
+	std::size_t maps; // size of mapping
+	std::size_t mlen; // bytes written to mapping
+	bool map_err;
+	
+	bool pull; // reading stdin/callback on demand, read data is dropped unless retained
+	bool pull_end; // no more data from stdin/callback
+	std::vector<unsigned char> sbuf; // data read from stdin/callback and not dropped yet
+	std::size_t spos; // read position in sbuf
+	std::size_t sdrop; // bytes of stdin/callback dropped before sbuf
+	
+	bool retain_; // keep stdin/stdout/callback data in memory until the stream is closed
+	bool unsent; // stdout/callback data was switched to reading and is not written yet
+	bool push_err; // callback did not take all data
+	std::size_t sent; // bytes already written to stdout/callback
+	StreamCallbacks cb;
+	
 	bool free_mem_sw;
 	void* source;
 	StreamMode mode;
 	StreamType srct;
-	int srcs;
+	std::size_t srcs;
 };
 
 #endif
\ No newline at end of file
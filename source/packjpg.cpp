@@ -269,14 +269,26 @@ ____________________________________
 packJPG by Matthias Stirner, 01/2016
 */
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <numeric>
+#include <set>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
+#include <cctype>
 #include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include "aricoder.h"
 #include "bitops.h"
@@ -298,12 +310,18 @@ packJPG by Matthias Stirner, 01/2016
 // #define DEV_BUILD // uncomment to include developer functions
 // #define DEV_INFOS // uncomment to include developer information
 
-int bitlen(int v) {
+// Number of bits needed to represent v (0 for v == 0).
+constexpr int bitlen(std::uint32_t v) {
+#if defined(__GNUC__)
+	return (v == 0) ? 0 : 32 - __builtin_clz(v);
+#else
 	int length = 0;
-	while ((v >> length) != 0) {
+	while (v != 0) {
+		v >>= 1;
 		length++;
 	}
 	return length;
+#endif
 }
 
 constexpr std::int16_t fdiv2(std::int16_t v, int p) {
@@ -331,11 +349,11 @@ constexpr int pack(std::uint8_t left, std::uint8_t right) {
 }
 
 constexpr int bitlen1024p(int v) {
-	return pbitlen_0_1024[v];
+	return bitlen(static_cast<std::uint32_t>(v));
 }
 
 constexpr int bitlen2048n(int v) {
-	return pbitlen_n2048_2047[v + 2048];
+	return bitlen(static_cast<std::uint32_t>((v < 0) ? -v : v));
 }
 
 constexpr int clamp(int val, int lo, int hi) {
@@ -388,10 +406,15 @@ struct componentInfo {
 	int jid; // jpeg internal id
 };
 
+// Packed AC symbols for coefficients -15...15 after runs of 0...15 zeroes, entry at
+// ( run << 5 ) + ( value + 16 ) holds ( ( huffman code << s ) | vli ) << 5 | ( code length + s ).
+using AcEmitTable = std::array<std::uint32_t, 16 * 32>;
+
 struct HuffCodes {
 	std::array<std::uint16_t, 256> cval = std::array<std::uint16_t, 256>{ 0 };
 	std::array<std::uint16_t, 256> clen = std::array<std::uint16_t, 256>{ 0 };
 	std::uint16_t max_eobrun = 0;
+	std::shared_ptr<const AcEmitTable> emit; // code & value in one write for small coefficients
 };
 
 struct HuffTree {
@@ -399,6 +422,20 @@ struct HuffTree {
 	std::array<std::uint16_t, 256> r = std::array<std::uint16_t, 256>{ 0 };
 };
 
+struct HuffTable {
+	int lval; // table class (0 = DC, 1 = AC)
+	int rval; // table destination
+	HuffCodes codes; // huffman codes
+	HuffTree tree; // huffman decoding tree
+};
+
+struct HeaderSegment {
+	std::uint8_t type; // type of marker segment
+	std::size_t pos; // position of marker segment in header
+	int len; // length of marker segment
+	std::vector<HuffTable> dht; // pre-built huffman tables (DHT segments only)
+};
+
 enum JpegType {
 	UNKNOWN = 0,
 	SEQUENTIAL = 1,
@@ -417,6 +454,10 @@ static void show_help();
 #endif
 static void process_file();
 static void execute( bool (*function)() );
+#if defined( BUILD_LIB )
+static void lib_init_streams( void* in_src, int in_type, std::size_t in_size, void* out_dest, int out_type );
+static bool lib_convert( unsigned char** out_file, std::size_t* out_size, char* msg );
+#endif
 
 
 /* -----------------------------------------------
@@ -424,10 +465,14 @@ static void execute( bool (*function)() );
 	----------------------------------------------- */
 #if !defined( BUILD_LIB )
 static bool check_file();
+static iostream* open_output( const std::string& name, StreamType type );
 static bool swap_streams();
 static bool compare_output();
 #endif
 static bool reset_buffers();
+static std::size_t estimate_memory(std::size_t* per_row);
+static void check_size_hints();
+static void sample_memory();
 static bool predict_dc();
 static bool unpredict_dc();
 static bool calc_zdst_lists();
@@ -449,10 +494,38 @@ char padbit = -1; // padbit (for huffman coding)
 int scan_count = 0; // count of scans
 int rsti = 0; // restart interval
 
-std::vector<std::uint32_t> scnp; // scan start positions in huffdata
-std::vector<std::uint32_t> rstp; // restart markers positions in huffdata
+std::vector<std::size_t> scnp; // scan start positions in huffdata
 std::vector<std::uint8_t> rst_err; // number of wrong-set RST markers per scan
+bool stuffed = false; // huffdata holds stuffed scans including RST markers (see recode)
+std::size_t scan_size = 0; // size of coded scans including stuffing & RST markers, 0 if unknown
+std::size_t out_size = 0; // size of the reconstructed JPEG file, 0 if unknown
+bool streamed = false; // header & scans are written to str_out while decoding / recoding
+bool soi_out = false; // SOI is written to str_out
+std::size_t hdr_out = 0; // header bytes already written to str_out
+std::vector<std::uint8_t> prescanned; // header data read by decode::prescan(), decode::read() starts with it
+std::size_t prescan_pos = 0; // bytes of prescanned used by decode::read()
+
+std::vector<HeaderSegment> hdrsegs; // index of marker segments in header data
+
+// Block-major staging area for sequential and first stage AC scans. Blocks are coded
+// to/from the tile in scan order and moved from/to band-major dct::colldata one tile
+// at a time, so each band array is swept once per tile instead of once per block.
+struct BlockTile {
+	static constexpr int capacity = 256; // 32kb of coefficients, stays in cache
+	std::array<std::array<std::int16_t, 64>, capacity> block; // coefficients, block-major
+	std::array<int, capacity> cmp; // component of each block
+	std::array<int, capacity> dpos; // position of each block in dct::colldata
+	std::array<int, capacity> eob; // bands below eob are coded (decoding only)
+	int count = 0; // number of blocks in the tile
+};
 
+// Transposes bands from...eob-1 of each block in the tile into dct::colldata, bands past eob stay zero.
+void tile_scatter(const BlockTile& tile, int from);
+// Transposes bands from...to of all blocks in the tile out of dct::colldata.
+void tile_gather(BlockTile& tile, int from, int to);
+
+// Builds the marker segment index for the header data.
+bool index_header();
 // Parses header for imageinfo.
 bool setup_imginfo();
 // JFIF header rebuilding routine.
@@ -468,8 +541,12 @@ namespace jfif {
 // Parses JFIF segment, returning true if the segment is valid in packjpg and the parse was successful, false otherwise.
 bool parse_jfif(unsigned char type, unsigned int len, const unsigned char* segment);
 
-// Helper function that parses DHT segments, returning true if the parse succeeds.
-bool parse_dht(unsigned int len, const unsigned char* segment);
+// Helper function that parses DHT segments into tables, returning true if the parse succeeds.
+bool parse_dht(unsigned int len, const unsigned char* segment, std::vector<HuffTable>& tables);
+// Makes pre-built huffman tables the current ones.
+void use_dht(const std::vector<HuffTable>& tables);
+// Applies indexed DHT, DRI and SOS segments for coding, skips all others.
+bool use_segment(const HeaderSegment& hseg);
 // Constructs Huffman codes from DHT data.
 HuffCodes build_huffcodes(const unsigned char* clen, const unsigned char* cval);
 // Constructs a Huffman tree from the given Huffman codes.
@@ -479,8 +556,10 @@ HuffTree build_hufftree(const HuffCodes& codes);
 bool parse_dqt(unsigned len, const unsigned char* segment);
 // Helper function that parses SOS segments, returning true if the parse succeeds.
 bool parse_sos(const unsigned char* segment);
-// Helper function that parses SOF0/SOF1/SOF2 segments, returning true if the parse succeeds.
-bool parse_sof(unsigned char type, const unsigned char* segment);
+// Helper function that checks SOF segments for supported coding, precision & dimensions, without changing any state.
+bool check_sof(unsigned char type, unsigned int len, const unsigned char* segment);
+// Helper function that parses SOF0/SOF1/SOF2 segments (checked by check_sof).
+void parse_sof(unsigned char type, const unsigned char* segment);
 // Helper function that parses DRI segments.
 void parse_dri(const unsigned char* segment);
 }
@@ -490,6 +569,14 @@ namespace encode {
 bool recode();
 // Merges header & image data to jpeg.
 bool merge();
+// Writes SOI and header data up to hpos to the output, if not done yet.
+void write_header(std::size_t hpos);
+// Hands coded bytes over to the output in streamed mode.
+void stream_out(const std::unique_ptr<abitwriter>& huffw);
+
+// Sequential encoding of one tile of blocks, interleaved or not.
+jpg::CodingStatus seq_tile(const std::unique_ptr<abitwriter>& huffw, BlockTile& tile, std::array<int, 4>& lastdc,
+                           int* mcu, int* cmp, int* csc, int* sub, int* dpos, int* rstw);
 
 // Sequential block encoding routine.
 int block_seq(const std::unique_ptr<abitwriter>& huffw, const HuffCodes& dctbl, const HuffCodes& actbl, const std::array<std::int16_t, 64>& block);
@@ -510,6 +597,10 @@ void crbits(const std::unique_ptr<abitwriter>& huffw, const std::unique_ptr<abyt
 }
 
 namespace decode {
+// Checks the header up to the first SOS for unsupported codings, without reading image data.
+bool prescan();
+// Reads header data, starting with the data read by prescan().
+std::size_t read_hdr(unsigned char* to, std::size_t size);
 // Read in header and image data.
 bool read();
 // JPEG decoding routine.
@@ -529,8 +620,11 @@ void dc_prg_sa(const std::unique_ptr<abitreader>& huffr, short* block);
 // Progressive AC SA decoding routine.
 int ac_prg_sa(const std::unique_ptr<abitreader>& huffr, const HuffTree& actree, short* block,
               int* eobrun, int from, int to);
-// Run of EOB SA decoding routine.
-void eobrun_sa(const std::unique_ptr<abitreader>& huffr, short* block, int* eobrun, int from, int to);
+// Run of EOB SA decoding routine, refines all blocks of the tile in one go.
+void eobrun_sa(const std::unique_ptr<abitreader>& huffr, const BlockTile& tile, int cmp, int from, int to);
+// Sequential decoding of one tile of blocks, interleaved or not.
+jpg::CodingStatus seq_tile(const std::unique_ptr<abitreader>& huffr, BlockTile& tile, std::array<int, 4>& lastdc,
+                           int* mcu, int* cmp, int* csc, int* sub, int* dpos, int* rstw);
 
 // Skips the eobrun, calculates next position.
 jpg::CodingStatus skip_eobrun(int cmpt, int* dpos, int* rstw, int* eobrun);
@@ -557,9 +651,9 @@ namespace pjg {
 		bool encode();
 
 		// Optimizes DHT segments for compression.
-		void optimize_dht(int hpos, const int len);
+		void optimize_dht(std::size_t hpos, const int len);
 		// Optimizes DQT segments for compression.
-		void optimize_dqt(int hpos, const int len);
+		void optimize_dqt(std::size_t hpos, const int len);
 		// Optimizes JFIF header for compression.
 		void optimize_header();
 
@@ -569,7 +663,7 @@ namespace pjg {
 		void dc(const std::unique_ptr<aricoder>& enc, int cmp);
 		void ac_high(const std::unique_ptr<aricoder>& enc, int cmp);
 		void ac_low(const std::unique_ptr<aricoder>& enc, int cmp);
-		bool generic(const std::unique_ptr<aricoder>& enc, unsigned char* data, int len);
+		bool generic(const std::unique_ptr<aricoder>& enc, unsigned char* data, std::size_t len);
 		void bit(const std::unique_ptr<aricoder>& enc, unsigned char bit);
 
 
@@ -582,9 +676,9 @@ namespace pjg {
 		bool decode();
 
 		// Undoes DHT segment optimizations.
-		void deoptimize_dht(int hpos, int segment_length);
+		void deoptimize_dht(std::size_t hpos, int segment_length);
 		// Undoes DQT segment optimizations.
-		void deoptimize_dqt(int hpos, int segment_length);
+		void deoptimize_dqt(std::size_t hpos, int segment_length);
 		// Undoes DHT and DQT (header) optimizations.
 		void deoptimize_header();
 
@@ -594,13 +688,37 @@ namespace pjg {
 	void dc(const std::unique_ptr<aricoder>& dec, int cmp);
 	void ac_high(const std::unique_ptr<aricoder>& dec, int cmp);
 	void ac_low(const std::unique_ptr<aricoder>& dec, int cmp);
-	bool generic(const std::unique_ptr<aricoder>& dec, unsigned char** data, int* len);
+	bool generic(const std::unique_ptr<aricoder>& dec, unsigned char** data, std::size_t* len);
 	std::vector<std::uint8_t> generic(const std::unique_ptr<aricoder>& dec);
 	std::uint8_t bit(const std::unique_ptr<aricoder>& dec);
 	}
 
-	void aavrg_prepare(unsigned short** abs_coeffs, int* weights, unsigned short* abs_store, int cmp);
-	int aavrg_context(unsigned short** abs_coeffs, int* weights, int pos, int p_y, int p_x, int r_x);
+	// Ring buffer holding the last three rows of a band for the average & sign contexts,
+	// rows are padded by two entries on the left and one on the right.
+	template <class T>
+	class RowRing {
+	public:
+		explicit RowRing(int w) : stride_(w + 3), data_(3 * std::size_t(w + 3)) {}
+		// Forgets all rows, O(1), rows are cleared when they are entered.
+		void reset() { curr_ = -1; }
+		// Makes p_y the current row, clearing the rows entered on the way.
+		void advance(int p_y) {
+			if (p_y - curr_ > 3) curr_ = p_y - 3;
+			while (curr_ < p_y) {
+				curr_++;
+				std::fill_n(row(curr_) - 2, stride_, T(0));
+			}
+		}
+		// Returns row p_y (p_y >= -2), valid for the current row and the two above.
+		T* row(int p_y) { return data_.data() + ((p_y + 3) % 3) * stride_ + 2; }
+	private:
+		int stride_;
+		int curr_ = -1;
+		std::vector<T> data_;
+	};
+
+	void aavrg_prepare(int* weights);
+	int aavrg_context(RowRing<unsigned short>& absv, const int* weights, int p_y, int p_x, int r_x);
 	int lakh_context(signed short** coeffs_x, signed short** coeffs_a, int* pred_cf, int pos);
 std::pair<int, int> get_context_nnb(int pos, int w);
 }
@@ -628,6 +746,142 @@ namespace dct {
 	int idct_2d_fst_8x1(int cmp, int dpos, int ix);
 }
 
+/*
+* Pooled storage for per image buffers (coefficients and zero distribution lists). It is
+* kept between files and only grows when a bigger image arrives.
+*/
+namespace arena {
+	constexpr std::size_t alignment = 64; // alignment of each array handed out
+
+	unsigned char* raw = nullptr; // allocated memory
+	unsigned char* base = nullptr; // aligned start of the arena
+	std::size_t capacity = 0; // size of the arena
+	std::size_t used = 0; // bytes handed out for the current image
+	std::size_t dirty = 0; // bytes handed out since allocation, these need zeroing when reused
+
+	// Rounds size up to the alignment.
+	constexpr std::size_t aligned(std::size_t size) {
+		return (size + alignment - 1) & ~(alignment - 1);
+	}
+	// Makes sure size bytes are available, handed out memory is invalidated if it grows.
+	bool reserve(std::size_t size);
+	// Hands out n zeroed, aligned elements of type T.
+	template <class T> T* take(std::size_t n);
+	// Makes all memory available again for the next image.
+	void rewind();
+}
+
+#if !defined(BUILD_LIB)
+/*
+* Background file io for runs over several files: the next files are mapped and paged in
+* ahead, finished PJG outputs are written behind, so coding does not wait for the disk.
+* JPEG outputs are mapped files, the system writes them back.
+*/
+namespace bgio {
+	constexpr std::size_t max_read = std::size_t(64) << 20; // bytes paged in ahead per file, the rest is read on demand
+	constexpr std::size_t max_pending = std::size_t(256) << 20; // bytes read ahead or waiting to be written
+
+	struct ReadJob {
+		std::string name;
+		iostream* str; // input stream, mapped (or in memory if files can't be mapped)
+		std::vector<unsigned char> data; // file data, if not mapped
+		std::size_t size; // bytes paged in or read
+		bool done; // reading finished
+		bool stale; // file is written in this run, data may be outdated
+	};
+	struct WriteJob {
+		std::string name;
+		std::string source; // name of the input file
+		int level; // errorlevel of the input file
+		FILE* file;
+		unsigned char* data;
+		std::size_t size;
+	};
+
+	int ahead = 2; // number of files read ahead ( 0: no background io )
+	bool on = false; // background io is used for this run
+
+	std::mutex mtx; // guards everything below
+	std::condition_variable cv; // signals any change
+	std::deque<ReadJob> reads; // files to read, in order of processing
+	std::deque<WriteJob> writes; // outputs to write, in order of processing
+	std::vector<WriteJob> write_errors; // outputs that could not be written
+	std::size_t pending = 0; // bytes held by reads and writes
+	bool quit = false;
+	std::thread reader;
+	std::thread writer;
+
+	FILE* out = nullptr; // output file of the current file, written behind
+	std::vector<unsigned char> data; // input data of the current file, if read ahead & not mapped
+
+	// Starts the io threads.
+	void start();
+	// Finishes all writes and ends the io threads.
+	void stop();
+	// Queues a file to be read ahead.
+	void read_ahead(const std::string& name);
+	// Gets the input stream of the next file, nullptr if it was not read ahead.
+	iostream* take(const std::string& name);
+	// Marks read ahead data of a file as outdated, the file is about to be written.
+	void forget(const std::string& name);
+	// Waits until a file is not being written anymore.
+	void wait_written(const std::string& name);
+	// Queues data to be written to file, the file is closed and data is freed afterwards.
+	void write_behind(const std::string& name, FILE* file, unsigned char* data, std::size_t size);
+	// Returns outputs that could not be written since the last call.
+	std::vector<WriteJob> failed();
+	// Io thread loops.
+	void read_loop();
+	void write_loop();
+}
+
+/*
+* Files to process, taken from the command line entries one by one: file names, "-" for stdin,
+* "@list" or "@-" for lists of names and "-r dir" for directory trees. Lists and directories are
+* read only as far as names are needed.
+*/
+namespace files {
+	enum class Kind { NAME, LIST, DIR };
+	struct Input {
+		Kind kind;
+		std::string name;
+	};
+	struct Dir {
+		std::string path;
+		std::vector<std::string> entries; // entry names as read when the directory was opened
+		std::size_t next = 0; // next entry to look at
+	};
+
+	std::vector<Input> inputs; // command line entries, in order
+	std::size_t pos = 0; // next entry of inputs
+	FILE* list = nullptr; // list being read
+	std::vector<Dir> dirs; // directories being walked, innermost last
+	std::deque<std::string> window; // names read from the inputs, not processed yet
+	bool largest_first = false; // sort all files by size before processing, largest first
+	std::size_t total = 0; // number of files if known up front ( 0: unknown )
+	std::size_t errors = 0; // lists or directories that could not be read
+	std::string curr; // name of the current file
+	std::set<std::string> written; // outputs of this run, never taken from directories
+
+	// Adds a command line entry.
+	void add(Kind kind, const std::string& name);
+	// Prepares the inputs for reading, sorts all files if needed.
+	void start();
+	// Makes the next file the current one, false after the last.
+	bool next();
+	// Makes sure n names after the current one are in the window, false if fewer are left.
+	bool peek(std::size_t n);
+	// Reads the next name from the inputs, false if none are left.
+	bool pull(std::string& name);
+	// Reads the entries of a directory to walk, outputs written later are not picked up.
+	void open_dir(const std::string& path);
+	// True for names of JPEG and PJG files, used for directory walks.
+	bool wanted(const std::string& name);
+	// Reports a list or directory that could not be read.
+	void report(const std::string& name, const char* msg);
+}
+#endif
+
 namespace predictor {
 #if defined( USE_PLOCOI )
 	// Returns predictor for collection data.
@@ -674,7 +928,7 @@ static bool dump_hdr();
 static bool dump_huf();
 static bool dump_coll();
 static bool dump_zdst();
-static bool dump_file( const std::string& base, const std::string& ext, void* data, int bpv, int size );
+static bool dump_file( const std::string& base, const std::string& ext, void* data, int bpv, std::size_t size );
 static bool dump_errfile();
 static bool dump_info();
 static bool dump_dist();
@@ -688,6 +942,7 @@ static bool dump_pgm();
 #if defined(BUILD_LIB)
 static int lib_in_type  = -1;
 static int lib_out_type = -1;
+static std::atomic<bool> lib_busy( false ); // a conversion works on the global state
 #endif
 
 
@@ -700,7 +955,7 @@ static unsigned short qtables[4][64];				// quantization tables
 static std::vector<std::uint8_t> grbgdata; // garbage data
 static unsigned char* hdrdata          =   nullptr;   // header data
 static std::vector<std::uint8_t> huffdata; // huffman coded data
-static int            hdrs             =    0  ;   // size of header
+static std::size_t    hdrs             =    0  ;   // size of header
 
 
 
@@ -743,7 +998,7 @@ int to = 0; // end - band of current scan ( inclusive )
 int sah = 0; // successive approximation bit pos high
 int sal = 0; // successive approximation bit pos low
 }
-	
+
 
 /* -----------------------------------------------
 	global variables: info about files
@@ -751,21 +1006,19 @@ int sal = 0; // successive approximation bit pos low
 	
 static std::string jpgfilename;	// name of JPEG file
 static std::string pjgfilename;	// name of PJG file
-static int    jpgfilesize;			// size of JPEG file
-static int    pjgfilesize;			// size of PJG file
+static std::size_t jpgfilesize;		// size of JPEG file
+static std::size_t pjgfilesize;		// size of PJG file
 static JpegType jpegtype = JpegType::UNKNOWN; // type of JPEG coding
 static FileType filetype;				// type of current file
+static std::size_t mem_estimate = 0;	// estimated peak memory for current file
+static std::size_t mem_sampled = 0;	// most memory seen between processing steps for current file
 static iostream* str_in  = nullptr;	// input stream
 static iostream* str_out = nullptr;	// output stream
 
 #if !defined(BUILD_LIB)
 static iostream* str_str = nullptr;	// storage stream
 
-static std::vector<std::string> filelist; // list of files to process 
 static std::size_t file_no = 0; // number of current file
-
-static std::vector<std::string> err_list; // list of error messages 
-static std::vector<int> err_tp; // list of error types
 #endif
 
 #if defined(DEV_INFOS)
@@ -811,7 +1064,7 @@ static bool auto_set   = true;	// automatic find best settings yes/no
 static Action action = Action::A_COMPRESS;// what to do with JPEG/PJG files
 
 static FILE*  msgout   = stdout;// stream for output of messages
-static bool   pipe_on  = false;	// use stdin/stdout instead of filelist
+static bool   pipe_on  = false;	// use stdin/stdout instead of files
 #else
 static int  err_tol    = 1;		// error threshold ( proceed on warnings yes (2) / no (1) )
 static bool disc_meta  = false;	// discard meta-info yes / no
@@ -821,6 +1074,7 @@ static Action action = Action::A_COMPRESS;// what to do with JPEG/PJG files
 
 static unsigned char nois_trs[ 4 ] = {6,6,6,6}; // bit pattern noise threshold
 static unsigned char segm_cnt[ 4 ] = {10,10,10,10}; // number of segments
+static int mem_limit = 0; // memory limit per file in MB ( 0: no limit )
 #if !defined(BUILD_LIB)
 static unsigned char orig_set[ 8 ] = { 0 }; // store array for settings
 #endif
@@ -832,6 +1086,7 @@ namespace program_info {
 	const std::string appname = "packjpg";
 	const std::string versiondate = "01/22/2016";
 	const std::string author = "Matthias Stirner / Se";
+	const std::array<std::uint8_t, 2> pjg_magic = { 'J', 'S' };
 #if !defined(BUILD_LIB)
 	const std::string website = "http://packjpg.encode.ru/";
 	const std::string copyright = "2006-2016 HTW Aalen University & Matthias Stirner";
@@ -839,7 +1094,6 @@ namespace program_info {
 
 	const std::string pjg_ext = "pjg";
 	const std::string jpg_ext = "jpg";
-	const std::array<std::uint8_t, 2> pjg_magic = { 'J', 'S' };
 #endif
 }
 
@@ -871,7 +1125,7 @@ int main( int argc, char** argv )
 	fprintf( msgout, "Copyright %s\nAll rights reserved\n\n", program_info::copyright.c_str() );
 	
 	// check if user input is wrong, show help screen if it is
-	if (filelist.empty() ||
+	if (files::inputs.empty() ||
 		( ( !developer ) && ( (action != Action::A_COMPRESS) || (!auto_set) || (verify_lv > 1) ) ) ) {
 		show_help();
 		return -1;
@@ -891,17 +1145,48 @@ int main( int argc, char** argv )
 	// (re)set program has to be done first
 	reset_buffers();
 	
+	// read names from lists and directories, sort them if needed
+	files::start();
+	
+	// read ahead and write behind if there is more than one file
+	bgio::on = ( bgio::ahead > 0 ) && files::peek( 2 ) && ( action == Action::A_COMPRESS );
+	if ( bgio::on ) bgio::start();
+	std::size_t queued = 0; // names at the front of the window queued for reading ahead
+	
+	// errors and warnings are reported as they happen (needed for -v2 or progress bar)
+	auto report = [ & ]( const std::string& name, int level, const char* msg ) {
+		if ( ( verbosity == -1 ) || ( verbosity == 2 ) )
+			fprintf( stderr, "\n%s: %s (%s)\n", ( level >= err_tol ) ? "error" : "warning", name.c_str(), msg );
+	};
+	
+	// files that could not be written behind count as errors
+	auto count_write_errors = [ & ]() {
+		for ( const auto& job : bgio::failed() ) {
+			const char* msg = "write error, possibly drive is full";
+			if ( job.level == 1 ) warn_cnt--;
+			error_cnt++;
+			if ( verbosity >= 0 )
+				fprintf( msgout, "\n\"%s\" -> ERROR\n %s\n", job.source.c_str(), msg );
+			report( job.source, 2, msg );
+		}
+	};
+	
 	// process file(s) - this is the main function routine
 
 	auto begin = std::chrono::steady_clock::now();
-	for ( file_no = 0; file_no < filelist.size(); file_no++ ) {
+	for ( file_no = 0; ; file_no++ ) {
+		// queue the next files for reading ahead
+		if ( bgio::on ) {
+			files::peek( bgio::ahead + 1 );
+			for ( ; ( queued < files::window.size() ) && ( queued <= std::size_t( bgio::ahead ) ); queued++ )
+				if ( files::window[ queued ] != "-" ) bgio::read_ahead( files::window[ queued ] );
+		}
+		if ( !files::next() ) break;
+		if ( queued > 0 ) queued--;
 		// process current file
 		process_ui();
-		// store error message and type if any
-		if ( errorlevel > 0 ) {
-			err_tp[file_no] = errorlevel;
-			err_list[file_no] = errormessage;
-		}
+		// report error message and type if any
+		if ( errorlevel > 0 ) report( files::curr, errorlevel, errormessage );
 		// count errors / warnings / file sizes
 		if ( errorlevel >= err_tol ) error_cnt++;
 		else {
@@ -909,37 +1194,20 @@ int main( int argc, char** argv )
 			acc_jpgsize += jpgfilesize;
 			acc_pjgsize += pjgfilesize;
 		}
+		count_write_errors();
 	}
-	auto end = std::chrono::steady_clock::now();
-	
-	// errors summary: only needed for -v2 or progress bar
-	if ( ( verbosity == -1 ) || ( verbosity == 2 ) ) {
-		// print summary of errors to screen
-		if ( error_cnt > 0 ) {
-			fprintf( stderr, "\n\nfiles with errors:\n" );
-			fprintf( stderr, "------------------\n" );
-			for ( file_no = 0; file_no < filelist.size(); file_no++ ) {
-				if ( err_tp[ file_no ] >= err_tol ) {
-					fprintf( stderr, "%s (%s)\n", filelist[ file_no ].c_str(), err_list[ file_no ].c_str());
-				}
-			}
-		}
-		// print summary of warnings to screen
-		if ( warn_cnt > 0 ) {
-			fprintf( stderr, "\n\nfiles with warnings:\n" );
-			fprintf( stderr, "------------------\n" );
-			for ( file_no = 0; file_no < filelist.size(); file_no++ ) {
-				if ( err_tp[ file_no ] == 1 ) {
-					fprintf( stderr, "%s (%s)\n", filelist[ file_no ].c_str(), err_list[ file_no ].c_str());
-				}
-			}
-		}
+	// wait for all writes to finish
+	if ( bgio::on ) {
+		bgio::stop();
+		count_write_errors();
 	}
+	error_cnt += files::errors;
+	auto end = std::chrono::steady_clock::now();
 	
 	// show statistics
 	fprintf( msgout,  "\n\n-> %i file(s) processed, %i error(s), %i warning(s)\n",
-		filelist.size(), error_cnt, warn_cnt );
-	if ( (static_cast<int>(filelist.size()) > error_cnt ) && ( verbosity != 0 ) &&
+		file_no, error_cnt, warn_cnt );
+	if ( (static_cast<int>(file_no) > error_cnt ) && ( verbosity != 0 ) &&
 	 ( action == Action::A_COMPRESS ) ) {
 		acc_jpgsize /= 1024.0;
 		acc_pjgsize /= 1024.0;
@@ -1001,7 +1269,7 @@ int main( int argc, char** argv )
 EXPORT bool pjglib_convert_stream2stream( char* msg )
 {
 	// process in main function
-	return pjglib_convert_stream2mem( nullptr, nullptr, msg ); 
+	return pjglib_convert_stream2mem64( nullptr, nullptr, msg ); 
 }
 
 /* -----------------------------------------------
@@ -1010,10 +1278,10 @@ EXPORT bool pjglib_convert_stream2stream( char* msg )
 EXPORT bool pjglib_convert_file2file( char* in, char* out, char* msg )
 {
 	// init streams
-	pjglib_init_streams( (void*) in, 0, 0, (void*) out, 0 );
+	pjglib_init_streams64( (void*) in, 0, 0, (void*) out, 0 );
 	
 	// process in main function
-	return pjglib_convert_stream2mem( nullptr, nullptr, msg ); 
+	return pjglib_convert_stream2mem64( nullptr, nullptr, msg ); 
 }
 
 /* -----------------------------------------------
@@ -1021,8 +1289,59 @@ EXPORT bool pjglib_convert_file2file( char* in, char* out, char* msg )
 	----------------------------------------------- */
 EXPORT bool pjglib_convert_stream2mem( unsigned char** out_file, unsigned int* out_size, char* msg )
 {
+	std::size_t size = 0;
+	
+	// process in the 64 bit function
+	if ( !pjglib_convert_stream2mem64( out_file, ( out_size != nullptr ) ? &size : nullptr, msg ) )
+		return false;
+	
+	// output must fit the 32 bit size
+	if ( ( out_file != nullptr ) && ( out_size != nullptr ) && ( lib_out_type == 1 ) ) {
+		if ( size > 0xFFFFFFFFu ) {
+			free( *out_file );
+			*out_file = nullptr;
+			if ( msg != nullptr ) sprintf( msg, "output too large, use pjglib_convert_stream2mem64()" );
+			return false;
+		}
+		*out_size = static_cast<unsigned int>( size );
+	}
+	
+	return true;
+}
+
+/* -----------------------------------------------
+	DLL export converter function (64 bit sizes)
+	----------------------------------------------- */
+EXPORT bool pjglib_convert_stream2mem64( unsigned char** out_file, std::size_t* out_size, char* msg )
+{
+	// one conversion at a time, the converter works on global state
+	bool idle = false;
+	if ( !lib_busy.compare_exchange_strong( idle, true ) ) {
+		if ( msg != nullptr ) sprintf( msg, "another conversion is in progress" );
+		return false;
+	}
+	
+	const bool ok = lib_convert( out_file, out_size, msg );
+	lib_busy = false;
+	
+	return ok;
+}
+
+/* -----------------------------------------------
+	converter for library calls, the caller holds lib_busy
+	----------------------------------------------- */
+static bool lib_convert( unsigned char** out_file, std::size_t* out_size, char* msg )
+{
+	// streams are opened by pjglib_init_streams() and closed after each conversion
+	if ( ( str_in == nullptr ) || ( str_out == nullptr ) ) {
+		if ( msg != nullptr ) sprintf( msg, "no streams to convert, call pjglib_init_streams() first" );
+		return false;
+	}
+	
 	// use automatic settings
 	auto_set = true;
+	mem_estimate = 0;
+	mem_sampled = 0;
 	
 	// (re)set buffers
 	reset_buffers();
@@ -1034,6 +1353,15 @@ EXPORT bool pjglib_convert_stream2mem( unsigned char** out_file, unsigned int* o
 	// process one file
 	process_file();
 	
+	// pass remaining output to the callback, its errors show up only now
+	if ( ( errorlevel < err_tol ) && ( lib_out_type == 3 ) ) {
+		str_out->flush();
+		if ( str_out->chkerr() ) {
+			sprintf( errormessage, "write error, output callback failed" );
+			errorlevel = 2;
+		}
+	}
+	
 	// fetch pointer and size of output (only for memory output)
 	if ( ( errorlevel < err_tol ) && ( lib_out_type == 1 ) &&
 		 ( out_file != nullptr ) && ( out_size != nullptr ) ) {
@@ -1091,6 +1419,49 @@ EXPORT bool pjglib_convert_stream2mem( unsigned char** out_file, unsigned int* o
 	DLL export init input (file/mem)
 	----------------------------------------------- */
 EXPORT void pjglib_init_streams( void* in_src, int in_type, int in_size, void* out_dest, int out_type )
+{
+	// negative sizes are treated as empty
+	pjglib_init_streams64( in_src, in_type, std::size_t( std::max( in_size, 0 ) ), out_dest, out_type );
+}
+
+/* -----------------------------------------------
+	stream type and source for library in-/output types
+	----------------------------------------------- */
+static StreamType lib_stream_type( int type, void*& src, StreamCallbacks& cb )
+{
+	switch ( type ) {
+		case 1:
+			return StreamType::kMemory;
+		case 2:
+			return StreamType::kStream;
+		case 3:
+			// pjglib_callbacks has its own declaration for the library users
+			if ( src != nullptr ) {
+				const pjglib_callbacks* user = static_cast<const pjglib_callbacks*>( src );
+				cb = StreamCallbacks{ user->read, user->write, user->opaque };
+				src = &cb;
+			}
+			return StreamType::kCallback;
+		default:
+			return StreamType::kFile;
+	}
+}
+
+/* -----------------------------------------------
+	DLL export init input (file/mem, 64 bit sizes)
+	----------------------------------------------- */
+EXPORT void pjglib_init_streams64( void* in_src, int in_type, std::size_t in_size, void* out_dest, int out_type )
+{
+	// streams of a running conversion are left alone, converting fails then
+	if ( lib_busy ) return;
+	
+	lib_init_streams( in_src, in_type, in_size, out_dest, out_type );
+}
+
+/* -----------------------------------------------
+	opens library in- and output streams
+	----------------------------------------------- */
+static void lib_init_streams( void* in_src, int in_type, std::size_t in_size, void* out_dest, int out_type )
 {
 	/* a short reminder about input/output stream types:
 	
@@ -1112,9 +1483,16 @@ EXPORT void pjglib_init_streams( void* in_src, int in_type, int in_size, void* o
 	in_type -> 2
 	in_size -> ignore
 	
+	if input is read through callbacks
+	---------------------------------
+	in_src -> pjglib_callbacks, only read and opaque are used
+	in_type -> 3
+	in_size -> ignore
+	
 	vice versa for output streams! */
 	
 	unsigned char buffer[ 2 ];
+	StreamCallbacks in_cb, out_cb;
 	
 	// (re)set errorlevel
 	errorfunction = nullptr;
@@ -1123,7 +1501,8 @@ EXPORT void pjglib_init_streams( void* in_src, int in_type, int in_size, void* o
 	pjgfilesize = 0;
 	
 	// open input stream, check for errors
-	str_in = new iostream( in_src, StreamType(in_type), in_size, StreamMode::kRead );
+	const StreamType in_stype = lib_stream_type( in_type, in_src, in_cb );
+	str_in = new iostream( in_src, in_stype, in_size, StreamMode::kRead );
 	if ( str_in->chkerr() ) {
 		sprintf( errormessage, "error opening input stream" );
 		errorlevel = 2;
@@ -1131,7 +1510,8 @@ EXPORT void pjglib_init_streams( void* in_src, int in_type, int in_size, void* o
 	}	
 	
 	// open output stream, check for errors
-	str_out = new iostream( out_dest, StreamType(out_type), 0, StreamMode::kWrite);
+	const StreamType out_stype = lib_stream_type( out_type, out_dest, out_cb );
+	str_out = new iostream( out_dest, out_stype, 0, StreamMode::kWrite);
 	if ( str_out->chkerr() ) {
 		sprintf( errormessage, "error opening output stream" );
 		errorlevel = 2;
@@ -1171,6 +1551,203 @@ EXPORT void pjglib_init_streams( void* in_src, int in_type, int in_size, void* o
 	lib_out_type = out_type;
 }
 
+/* -----------------------------------------------
+	state of a conversion fed in portions
+	----------------------------------------------- */
+struct pjglib_ctx {
+	std::mutex mtx; // guards everything below
+	std::condition_variable cv; // signals input, output and the end of conversion
+	std::deque<std::vector<unsigned char>> in; // input portions not yet converted
+	std::size_t in_pos = 0; // position in the first input portion
+	bool in_end = false; // no more input will be fed
+	bool starved = false; // conversion waits for more input
+	std::deque<std::vector<unsigned char>> out; // output portions not yet handed out
+	std::vector<unsigned char> handed; // output portion handed out last
+	bool running = false; // worker was started, it holds lib_busy until done
+	bool done = false; // conversion has ended
+	bool ok = false; // conversion was successful
+	char msg[ 256 ] = ""; // message of the conversion
+	std::thread worker; // runs the conversion
+};
+
+/* -----------------------------------------------
+	input callback of a context, waits for input
+	----------------------------------------------- */
+static std::size_t pjglib_ctx_read( void* opaque, unsigned char* buf, std::size_t size )
+{
+	auto ctx = static_cast<pjglib_ctx*>( opaque );
+	std::unique_lock<std::mutex> lock( ctx->mtx );
+	
+	if ( ctx->in.empty() && !ctx->in_end ) {
+		ctx->starved = true;
+		ctx->cv.notify_all();
+		ctx->cv.wait( lock, [ctx]() { return !ctx->in.empty() || ctx->in_end; } );
+	}
+	ctx->starved = false;
+	if ( ctx->in.empty() ) return 0;
+	
+	// copy from the first portion, free it once it is used up
+	const std::vector<unsigned char>& portion = ctx->in.front();
+	const std::size_t n = std::min( size, portion.size() - ctx->in_pos );
+	std::copy( portion.begin() + ctx->in_pos, portion.begin() + ctx->in_pos + n, buf );
+	ctx->in_pos += n;
+	if ( ctx->in_pos == portion.size() ) {
+		ctx->in.pop_front();
+		ctx->in_pos = 0;
+	}
+	
+	return n;
+}
+
+/* -----------------------------------------------
+	output callback of a context, queues output
+	----------------------------------------------- */
+static std::size_t pjglib_ctx_write( void* opaque, const unsigned char* buf, std::size_t size )
+{
+	auto ctx = static_cast<pjglib_ctx*>( opaque );
+	std::lock_guard<std::mutex> lock( ctx->mtx );
+	
+	ctx->out.emplace_back( buf, buf + size );
+	ctx->cv.notify_all();
+	
+	return size;
+}
+
+/* -----------------------------------------------
+	conversion of a context, runs on its worker
+	----------------------------------------------- */
+static void pjglib_ctx_convert( pjglib_ctx* ctx )
+{
+	char msg[ 256 ] = "";
+	
+	// lib_busy was taken by pjglib_feed() for this context
+	pjglib_callbacks cb = { &pjglib_ctx_read, &pjglib_ctx_write, ctx };
+	lib_init_streams( &cb, 3, 0, &cb, 3 );
+	const bool ok = lib_convert( nullptr, nullptr, msg );
+	lib_busy = false;
+	
+	std::lock_guard<std::mutex> lock( ctx->mtx );
+	strcpy( ctx->msg, msg );
+	ctx->ok = ok;
+	ctx->done = true;
+	// input that was not read is of no use anymore
+	ctx->in.clear();
+	ctx->cv.notify_all();
+}
+
+/* -----------------------------------------------
+	DLL export new conversion context
+	----------------------------------------------- */
+EXPORT pjglib_ctx* pjglib_ctx_new()
+{
+	return new pjglib_ctx;
+}
+
+/* -----------------------------------------------
+	DLL export free conversion context
+	----------------------------------------------- */
+EXPORT void pjglib_ctx_free( pjglib_ctx* ctx )
+{
+	if ( ctx == nullptr ) return;
+	
+	// a conversion in progress sees the end of its input
+	{
+		std::lock_guard<std::mutex> lock( ctx->mtx );
+		ctx->in_end = true;
+		ctx->cv.notify_all();
+	}
+	if ( ctx->worker.joinable() ) ctx->worker.join();
+	
+	delete ctx;
+}
+
+/* -----------------------------------------------
+	DLL export feed input to a context
+	----------------------------------------------- */
+EXPORT int pjglib_feed( pjglib_ctx* ctx, const unsigned char* data, std::size_t size )
+{
+	if ( ctx == nullptr ) return PJGLIB_ERROR;
+	
+	std::unique_lock<std::mutex> lock( ctx->mtx );
+	if ( ctx->in_end ) return PJGLIB_ERROR;
+	if ( ctx->done ) return ctx->ok ? PJGLIB_DONE : PJGLIB_ERROR;
+	
+	// the input is converted on the worker, feeding never blocks
+	if ( size > 0 ) {
+		// the first input starts the conversion, one conversion at a time
+		if ( !ctx->running ) {
+			bool idle = false;
+			if ( !lib_busy.compare_exchange_strong( idle, true ) ) return PJGLIB_ERROR;
+		}
+		ctx->in.emplace_back( data, data + size );
+		ctx->starved = false;
+		ctx->cv.notify_all();
+		if ( !ctx->running ) {
+			ctx->running = true;
+			ctx->worker = std::thread( pjglib_ctx_convert, ctx );
+		}
+	}
+	
+	return ( ctx->out.empty() ) ? PJGLIB_NEED_MORE_INPUT : PJGLIB_OUTPUT;
+}
+
+/* -----------------------------------------------
+	DLL export end input of a context, wait for its conversion
+	----------------------------------------------- */
+EXPORT int pjglib_finish( pjglib_ctx* ctx, char* msg )
+{
+	if ( ctx == nullptr ) return PJGLIB_ERROR;
+	
+	{
+		std::lock_guard<std::mutex> lock( ctx->mtx );
+		if ( ctx->in_end ) return PJGLIB_ERROR;
+		ctx->in_end = true;
+		ctx->cv.notify_all();
+		if ( !ctx->running ) {
+			if ( msg != nullptr ) sprintf( msg, "no input data" );
+			return PJGLIB_ERROR;
+		}
+	}
+	ctx->worker.join();
+	
+	if ( msg != nullptr ) strcpy( msg, ctx->msg );
+	if ( !ctx->ok ) {
+		ctx->out.clear();
+		return PJGLIB_ERROR;
+	}
+	
+	return ( ctx->out.empty() ) ? PJGLIB_DONE : PJGLIB_OUTPUT;
+}
+
+/* -----------------------------------------------
+	DLL export get next output portion of a context
+	----------------------------------------------- */
+EXPORT int pjglib_read_output( pjglib_ctx* ctx, const unsigned char** chunk, std::size_t* size )
+{
+	if ( ( ctx == nullptr ) || ( chunk == nullptr ) || ( size == nullptr ) ) return PJGLIB_ERROR;
+	
+	std::unique_lock<std::mutex> lock( ctx->mtx );
+	
+	// the previous portion was handed out before, free it
+	std::vector<unsigned char>().swap( ctx->handed );
+	
+	// wait until there is output or the conversion needs more input or has ended
+	ctx->cv.wait( lock, [ctx]() {
+		return !ctx->out.empty() || ctx->done || !ctx->running ||
+			( ctx->starved && !ctx->in_end ); } );
+	
+	if ( !ctx->out.empty() ) {
+		ctx->handed.swap( ctx->out.front() );
+		ctx->out.pop_front();
+		*chunk = ctx->handed.data();
+		*size  = ctx->handed.size();
+		return PJGLIB_OUTPUT;
+	}
+	if ( ctx->done ) return ctx->ok ? PJGLIB_DONE : PJGLIB_ERROR;
+	
+	return PJGLIB_NEED_MORE_INPUT;
+}
+
 /* -----------------------------------------------
 	DLL export version information
 	----------------------------------------------- */
@@ -1243,6 +1820,17 @@ static void initialize_options( int argc, char** argv )
 		else if (arg == "-o") {
 			overwrite = true;
 		}
+		else if ( sscanf(arg.c_str(), "-mem%i", &tmp_val ) == 1 ) {
+			mem_limit = ( tmp_val < 0 ) ? 0 : tmp_val;
+		}
+		else if ( sscanf(arg.c_str(), "-io%i", &tmp_val ) == 1 ) {
+			tmp_val = ( tmp_val < 0 ) ? 0 : tmp_val;
+			tmp_val = ( tmp_val > 64 ) ? 64 : tmp_val;
+			bgio::ahead = tmp_val;
+		}
+		else if (arg == "-lf") {
+			files::largest_first = true;
+		}
 		#if defined(DEV_BUILD)
 		else if (arg == "-dev") {
 			developer = true;
@@ -1319,18 +1907,24 @@ static void initialize_options( int argc, char** argv )
 			// switch standard message out stream
 			msgout = stderr;
 			// use "-" as placeholder for stdin
-			filelist.push_back("-");
+			files::add( files::Kind::NAME, "-" );
+		}
+		else if ( ( arg == "-r" ) && ( argc > 1 ) ) {
+			// directory tree, walked when its files are needed
+			argc--;
+			argv++;
+			files::add( files::Kind::DIR, *argv );
+		}
+		else if ( ( arg.size() > 1 ) && ( arg[ 0 ] == '@' ) ) {
+			// list of filenames, "@-" reads it from stdin
+			files::add( files::Kind::LIST, arg.substr( 1 ) );
 		}
 		else {
 			// if argument is not switch, it's a filename
-			filelist.push_back(arg);
+			files::add( files::Kind::NAME, arg );
 		}		
 	}
 	
-	// alloc arrays for error messages and types storage
-	err_list = std::vector<std::string>(filelist.size());
-	err_tp   = std::vector<int>(filelist.size());
-	
 	// backup settings - needed to restore original setting later
 	if ( !auto_set ) {
 		orig_set[ 0 ] = nois_trs[ 0 ];
@@ -1358,14 +1952,16 @@ static void process_ui()
 	errorlevel = 0;
 	jpgfilesize = 0;
 	pjgfilesize = 0;	
+	mem_estimate = 0;
+	mem_sampled = 0;
 	#if !defined(DEV_BUILD)
 	action = Action::A_COMPRESS;
 	#endif
 	
 	// compare file name, set pipe if needed
-	if ( filelist[ file_no ] == "-" && ( action == Action::A_COMPRESS ) ) {
+	if ( files::curr == "-" && ( action == Action::A_COMPRESS ) ) {
 		pipe_on = true;
-		filelist[ file_no ] = "STDIN";
+		files::curr = "STDIN";
 	}
 	else {		
 		pipe_on = false;
@@ -1373,8 +1969,11 @@ static void process_ui()
 
 	std::string actionmsg;
 	if ( verbosity >= 0 ) { // standard UI
-		fprintf( msgout,  "\nProcessing file %u of %u \"%s\" -> ",
-					file_no + 1, filelist.size(), filelist[ file_no ].c_str() );
+		if ( files::total > 0 )
+			fprintf( msgout,  "\nProcessing file %u of %u \"%s\" -> ",
+						file_no + 1, files::total, files::curr.c_str() );
+		else
+			fprintf( msgout,  "\nProcessing file %u \"%s\" -> ", unsigned( file_no + 1 ), files::curr.c_str() );
 		
 		if ( verbosity > 1 )
 			fprintf( msgout,  "\n----------------------------------------" );
@@ -1399,8 +1998,12 @@ static void process_ui()
 	}
 	else { // progress bar UI
 		// update progress message
-		fprintf( msgout, "Processing file %2u of %2u ", file_no + 1, filelist.size());
-		progress_bar( static_cast<int>(file_no), filelist.size());
+		if ( files::total > 0 ) {
+			fprintf( msgout, "Processing file %2u of %2u ", file_no + 1, files::total);
+			progress_bar( static_cast<int>(file_no), files::total);
+		}
+		else // no bar while the number of files is unknown
+			fprintf( msgout, "Processing file %2u ", unsigned( file_no + 1 ) );
 		fprintf( msgout, "\r" );
 		execute( check_file );
 	}
@@ -1413,10 +2016,30 @@ static void process_ui()
 	// streams are initiated, start processing file
 	process_file();
 	
+	// hand the output to the background writer, a broken output is removed below
+	if ( bgio::out != nullptr ) {
+		std::size_t size = 0;
+		unsigned char* data = nullptr;
+		if ( errorlevel < err_tol ) {
+			// verification has read the output back
+			data = ( ( verify_lv > 0 ) ? str_in : str_out )->detach( &size );
+			if ( data == nullptr ) {
+				sprintf( errormessage, "write error, possibly drive is full" );
+				errorlevel = 2;
+			}
+		}
+		if ( data != nullptr )
+			bgio::write_behind( ( filetype == FileType::F_JPG ) ? pjgfilename : jpgfilename, bgio::out, data, size );
+		else
+			fclose( bgio::out );
+		bgio::out = nullptr;
+	}
+	
 	// close iostreams
 	if ( str_in  != nullptr ) delete( str_in  ); str_in  = nullptr;
 	if ( str_out != nullptr ) delete( str_out ); str_out = nullptr;
 	if ( str_str != nullptr ) delete( str_str ); str_str = nullptr;
+	std::vector<unsigned char>().swap( bgio::data );
 	// delete if broken or if output not needed
 	if ( ( !pipe_on ) && ( ( errorlevel >= err_tol ) || ( action != Action::A_COMPRESS ) ) ) {
 		if ( filetype == FileType::F_JPG ) {
@@ -1474,7 +2097,7 @@ static void process_ui()
 			auto total = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
 			if ( total >= 0 ) {
 				fprintf( msgout,  " time taken  : %7lld msec\n", total );
-				int bpms = (total > 0) ? (jpgfilesize / total) : jpgfilesize;
+				int bpms = int( (total > 0) ? (jpgfilesize / total) : jpgfilesize );
 				fprintf( msgout,  " byte per ms : %7i byte\n", bpms );
 			}
 			else {
@@ -1482,15 +2105,17 @@ static void process_ui()
 				fprintf( msgout,  " byte per ms : %7s byte\n", "N/A" );
 			}
 			fprintf( msgout,  " comp. ratio : %7.2f %%\n", cr );		
+			fprintf( msgout,  " mem. est.   : %7i kbyte\n", int( mem_estimate >> 10 ) );
+			fprintf( msgout,  " mem. sampled: %7i kbyte\n", int( mem_sampled >> 10 ) );
 		}	
 		if ( ( verbosity > 1 ) && ( action == Action::A_COMPRESS ) )
 			fprintf( msgout,  "\n" );
 	}
 	else { // progress bar UI
 		// if this is the last file, update progress bar one last time
-		if ( file_no + 1 == filelist.size()) {
+		if ( !files::peek( 1 ) ) {
 			// update progress message
-			fprintf( msgout, "Processed %2u of %2u files ", file_no + 1, filelist.size());
+			fprintf( msgout, "Processed %2u of %2u files ", file_no + 1, file_no + 1);
 			progress_bar( 1, 1 );
 			fprintf( msgout, "\r" );
 		}	
@@ -1506,6 +2131,8 @@ static inline std::string get_status( bool (*function)() )
 		return "unknown action";
 	} else if ( function == *check_file ) {
 		return "Determining filetype";
+	} else if ( function == *jpg::decode::prescan ) {
+		return "Checking JPEG header";
 	} else if ( function == *jpg::decode::read ) {
 		return "Reading header & image data";
 	} else if ( function == *jpg::encode::merge ) {
@@ -1577,6 +2204,11 @@ static void show_help()
 	fprintf( msgout, " [-o]     overwrite existing files\n" );
 	fprintf( msgout, " [-p]     proceed on warnings\n" );
 	fprintf( msgout, " [-d]     discard meta-info\n" );
+	fprintf( msgout, " [-mem?]  limit memory per file to ? MB\n" );
+	fprintf( msgout, " [-io?]   read ? files ahead, write in background (def: 2)\n" );
+	fprintf( msgout, " [-r ?]   process JPEG/PJG files in directory ? and below\n" );
+	fprintf( msgout, " [@?]     process files listed in file ? (@-: list from stdin)\n" );
+	fprintf( msgout, " [-lf]    process largest files first\n" );
 	#if defined(DEV_BUILD)
 	if ( developer ) {
 	fprintf( msgout, "\n" );
@@ -1610,6 +2242,8 @@ static void show_help()
 static void process_file()
 {	
 	if ( filetype == FileType::F_JPG ) {
+		// reject unsupported files before any image data is read
+		execute( jpg::decode::prescan );
 		switch ( action ) {
 			case Action::A_COMPRESS:
 				execute( jpg::decode::read );
@@ -1797,6 +2431,7 @@ static void execute( bool (*function)() )
 		bool success = ( *function )();
 		// set endtime
 		auto end = std::chrono::steady_clock::now();
+		sample_memory();
 		
 		if ( ( errorlevel > 0 ) && ( errorfunction == nullptr ) )
 			errorfunction = function;
@@ -1814,6 +2449,7 @@ static void execute( bool (*function)() )
 		#else
 		// call function
 		( *function )();
+		sample_memory();
 		
 		// store errorfunction if needed
 		if ( ( errorlevel > 0 ) && ( errorfunction == nullptr ) )
@@ -1822,67 +2458,417 @@ static void execute( bool (*function)() )
 	}
 }
 
-/* ----------------------- End of main interface functions -------------------------- */
+#if !defined(BUILD_LIB)
+/* -----------------------------------------------
+	background io: thread control
+	----------------------------------------------- */
 
-/* ----------------------- Begin of main functions -------------------------- */
+void bgio::start()
+{
+	quit = false;
+	reader = std::thread( read_loop );
+	writer = std::thread( write_loop );
+}
 
+void bgio::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock( mtx );
+		quit = true;
+	}
+	cv.notify_all();
+	reader.join();
+	writer.join();
+	for ( auto& job : reads )
+		delete job.str;
+	reads.clear();
+	pending = 0;
+}
 
 /* -----------------------------------------------
-	check file and determine filetype
+	background io: reading ahead
 	----------------------------------------------- */
 
-#if !defined(BUILD_LIB)
-static bool check_file()
-{	
-	unsigned char fileid[ 2 ] = { 0, 0 };
-	const std::string& filename = filelist[ file_no ];
-	
-	
-	// open input stream, check for errors
-	str_in = new iostream( (void*) filename.c_str(), ( !pipe_on ) ? StreamType::kFile : StreamType::kStream, 0, StreamMode::kRead );
-	if ( str_in->chkerr() ) {
-		sprintf( errormessage, FRD_ERRMSG.c_str(), filename.c_str());
-		errorlevel = 2;
-		return false;
+void bgio::read_ahead( const std::string& name )
+{
+	{
+		std::lock_guard<std::mutex> lock( mtx );
+		reads.push_back( ReadJob{ name, nullptr, {}, 0, false, false } );
 	}
+	cv.notify_all();
+}
+
+iostream* bgio::take( const std::string& name )
+{
+	std::unique_lock<std::mutex> lock( mtx );
+	if ( reads.empty() || ( reads.front().name != name ) ) return nullptr;
+	cv.wait( lock, [] { return reads.front().done; } );
 	
-	// free memory from filenames if needed
-	jpgfilename = "";
-	pjgfilename = "";
-	
-	// immediately return error if 2 bytes can't be read
-	if ( str_in->read( fileid, 2 ) != 2 ) { 
-		filetype = FileType::F_UNK;
-		sprintf( errormessage, "file doesn't contain enough data" );
-		errorlevel = 2;
-		return false;
+	ReadJob& job = reads.front();
+	iostream* str = job.str;
+	if ( job.stale ) {
+		delete str;
+		str = nullptr;
 	}
+	else if ( !job.data.empty() ) {
+		data = std::move( job.data );
+	}
+	pending -= job.size;
+	reads.pop_front();
+	lock.unlock();
+	cv.notify_all();
 	
-	// check file id, determine filetype
-	if ( ( fileid[0] == 0xFF ) && ( fileid[1] == 0xD8 ) ) {
-		// file is JPEG
-		filetype = FileType::F_JPG;
-		// create filenames
-		if ( !pipe_on ) {
-			jpgfilename = filename;
-			pjgfilename = ( overwrite ) ?
-				create_filename( filename, program_info::pjg_ext ) :
-				unique_filename(filename, program_info::pjg_ext);
-		}
-		else {
-			jpgfilename = create_filename( "STDIN", "" );
-			pjgfilename = create_filename( "STDOUT", "" );
+	return str;
+}
+
+void bgio::forget( const std::string& name )
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	for ( auto& job : reads )
+		if ( job.name == name ) job.stale = true;
+}
+
+void bgio::read_loop()
+{
+	std::unique_lock<std::mutex> lock( mtx );
+	while ( !quit ) {
+		// next file not read yet, read only while the budget allows
+		auto next = std::find_if( reads.begin(), reads.end(), []( const ReadJob& job ) { return !job.done; } );
+		if ( ( next == reads.end() ) || ( pending >= max_pending ) ) {
+			cv.wait( lock );
+			continue;
 		}
-		// open output stream, check for errors
-		str_out = new iostream( (void*) pjgfilename.c_str(), ( !pipe_on ) ? StreamType::kFile : StreamType::kStream, 0, StreamMode::kWrite );
-		if ( str_out->chkerr() ) {
-			sprintf( errormessage, FWR_ERRMSG.c_str(), pjgfilename.c_str() );
-			errorlevel = 2;
-			return false;
+		ReadJob& job = *next; // stays valid, only taken once done
+		const std::string name = job.name;
+		
+		// outputs of this run are read when their turn comes
+		if ( std::any_of( writes.begin(), writes.end(), [ &name ]( const WriteJob& out ) { return out.name == name; } ) ) {
+			job.done = true;
+			job.stale = true;
+			cv.notify_all();
+			continue;
 		}
-		// JPEG specific settings - restore original settings
-		if ( orig_set[ 0 ] == 0 )
-			auto_set = true;
+		lock.unlock();
+		
+		// map the file & page in its start, where files can't be mapped they are read
+		// into memory, files too large for that are left to the main thread
+		// (file streams have 64 bit sizes, long is 32 bit on some systems)
+		std::vector<unsigned char> data;
+		iostream* str = new iostream( (void*) name.c_str(), StreamType::kMapped, 0, StreamMode::kRead );
+		std::size_t size = 0;
+		if ( !str->chkerr() ) size = str->prefetch( max_read );
+		if ( size == 0 ) {
+			bool ok = false;
+			if ( !str->chkerr() ) {
+				size = str->getsize();
+				if ( ( size > 0 ) && ( size <= max_read ) ) {
+					data.resize( size );
+					ok = ( str->read( data.data(), size ) == size );
+				}
+			}
+			delete str;
+			str = nullptr;
+			if ( ok ) str = new iostream( data.data(), StreamType::kMemory, size, StreamMode::kRead );
+			else {
+				std::vector<unsigned char>().swap( data );
+				size = 0;
+			}
+		}
+		
+		lock.lock();
+		job.str = str;
+		job.data = std::move( data );
+		job.size = size;
+		job.done = true;
+		pending += size;
+		cv.notify_all();
+	}
+}
+
+/* -----------------------------------------------
+	background io: writing behind
+	----------------------------------------------- */
+
+void bgio::write_behind( const std::string& name, FILE* file, unsigned char* data, std::size_t size )
+{
+	std::unique_lock<std::mutex> lock( mtx );
+	// wait for room, one output is always accepted
+	cv.wait( lock, [] { return writes.empty() || ( pending < max_pending ); } );
+	writes.push_back( WriteJob{ name, files::curr, errorlevel, file, data, size } );
+	pending += size;
+	lock.unlock();
+	cv.notify_all();
+}
+
+void bgio::wait_written( const std::string& name )
+{
+	std::unique_lock<std::mutex> lock( mtx );
+	cv.wait( lock, [ &name ] {
+		return std::none_of( writes.begin(), writes.end(), [ &name ]( const WriteJob& job ) { return job.name == name; } );
+	} );
+}
+
+std::vector<bgio::WriteJob> bgio::failed()
+{
+	std::lock_guard<std::mutex> lock( mtx );
+	std::vector<WriteJob> list;
+	list.swap( write_errors );
+	return list;
+}
+
+void bgio::write_loop()
+{
+	std::unique_lock<std::mutex> lock( mtx );
+	for ( ;; ) {
+		cv.wait( lock, [] { return quit || !writes.empty(); } );
+		if ( writes.empty() ) return; // quit once everything is written
+		const WriteJob job = writes.front();
+		lock.unlock();
+		
+		bool ok = ( job.data != nullptr ) || ( job.size == 0 );
+		if ( ok ) ok = ( fwrite( job.data, 1, job.size, job.file ) == job.size );
+		ok = ( fclose( job.file ) == 0 ) && ok;
+		free( job.data );
+		if ( !ok ) remove( job.name.c_str() );
+		
+		lock.lock();
+		if ( !ok ) write_errors.push_back( WriteJob{ job.name, job.source, job.level, nullptr, nullptr, 0 } );
+		pending -= job.size;
+		writes.pop_front();
+		cv.notify_all();
+	}
+}
+/* -----------------------------------------------
+	file source: command line entries
+	----------------------------------------------- */
+
+void files::add( Kind kind, const std::string& name )
+{
+	inputs.push_back( Input{ kind, name } );
+}
+
+void files::start()
+{
+	// the number of files is known if all are given by name
+	if ( std::all_of( inputs.begin(), inputs.end(), []( const Input& in ) { return in.kind == Kind::NAME; } ) )
+		total = inputs.size();
+	if ( !largest_first ) return;
+	
+	// all names have to be read for sorting
+	std::vector<std::pair<std::int64_t, std::string>> sorted;
+	std::string name;
+	while ( pull( name ) ) {
+		struct stat st;
+		const std::int64_t size = ( stat( name.c_str(), &st ) == 0 ) ? std::int64_t( st.st_size ) : 0;
+		sorted.emplace_back( size, name );
+	}
+	std::stable_sort( sorted.begin(), sorted.end(), []( const std::pair<std::int64_t, std::string>& a, const std::pair<std::int64_t, std::string>& b ) {
+		return a.first > b.first;
+	} );
+	for ( auto& file : sorted ) window.push_back( std::move( file.second ) );
+	total = window.size();
+}
+
+bool files::next()
+{
+	if ( !peek( 1 ) ) return false;
+	curr = std::move( window.front() );
+	window.pop_front();
+	
+	return true;
+}
+
+bool files::peek( std::size_t n )
+{
+	std::string name;
+	while ( ( window.size() < n ) && pull( name ) )
+		window.push_back( name );
+	
+	return window.size() >= n;
+}
+
+/* -----------------------------------------------
+	file source: reading lists and directories
+	----------------------------------------------- */
+
+bool files::pull( std::string& name )
+{
+	for ( ;; ) {
+		// walk the innermost directory first
+		if ( !dirs.empty() ) {
+			Dir& dir = dirs.back();
+			if ( dir.next == dir.entries.size() ) {
+				dirs.pop_back();
+				continue;
+			}
+			const std::string entry_name = dir.entries[ dir.next++ ];
+			const std::string path = dir.path + "/" + entry_name;
+			struct stat st;
+			if ( stat( path.c_str(), &st ) != 0 ) continue;
+			if ( S_ISDIR( st.st_mode ) ) {
+				#if defined(UNIX)
+				// linked directories are not followed, they might form loops
+				struct stat lst;
+				if ( ( lstat( path.c_str(), &lst ) != 0 ) || S_ISLNK( lst.st_mode ) ) continue;
+				#endif
+				open_dir( path );
+				continue;
+			}
+			if ( !S_ISREG( st.st_mode ) || !wanted( entry_name ) ) continue;
+			// a directory read after files were written to it holds their outputs
+			if ( written.count( path ) > 0 ) continue;
+			name = path;
+			return true;
+		}
+		
+		// then the current list, one name per line
+		if ( list != nullptr ) {
+			char buffer[ 1024 ];
+			std::string line;
+			while ( fgets( buffer, sizeof( buffer ), list ) != nullptr ) {
+				line += buffer;
+				if ( line.back() == '\n' ) break;
+			}
+			if ( line.empty() ) {
+				if ( ferror( list ) ) report( ( list == stdin ) ? "STDIN" : inputs[ pos - 1 ].name, "list can't be read" );
+				if ( list != stdin ) fclose( list );
+				list = nullptr;
+				continue;
+			}
+			while ( !line.empty() && ( ( line.back() == '\n' ) || ( line.back() == '\r' ) ) ) line.pop_back();
+			if ( line.empty() ) continue;
+			name = line;
+			return true;
+		}
+		
+		// then the next command line entry
+		if ( pos == inputs.size() ) return false;
+		const Input& in = inputs[ pos++ ];
+		switch ( in.kind ) {
+			case Kind::NAME:
+				name = in.name;
+				return true;
+			case Kind::LIST:
+				list = ( in.name == "-" ) ? stdin : fopen( in.name.c_str(), "r" );
+				if ( list == nullptr ) report( in.name, "list can't be read" );
+				break;
+			case Kind::DIR: {
+				// no trailing separators, names are joined with '/'
+				std::string path = in.name;
+				while ( ( path.size() > 1 ) && ( ( path.back() == '/' ) || ( path.back() == '\\' ) ) ) path.pop_back();
+				open_dir( path );
+				break;
+			}
+		}
+	}
+}
+
+void files::open_dir( const std::string& path )
+{
+	DIR* dir = opendir( path.c_str() );
+	if ( dir == nullptr ) {
+		report( path, "directory can't be read" );
+		return;
+	}
+	
+	// all entries are read right away, outputs of this run end up in the same directories
+	Dir walk;
+	walk.path = path;
+	for ( const dirent* entry = readdir( dir ); entry != nullptr; entry = readdir( dir ) ) {
+		const std::string entry_name = entry->d_name;
+		if ( ( entry_name != "." ) && ( entry_name != ".." ) ) walk.entries.push_back( entry_name );
+	}
+	closedir( dir );
+	dirs.push_back( std::move( walk ) );
+}
+
+bool files::wanted( const std::string& name )
+{
+	const auto dot = name.find_last_of( '.' );
+	if ( dot == std::string::npos ) return false;
+	std::string ext = name.substr( dot + 1 );
+	std::transform( ext.begin(), ext.end(), ext.begin(), []( unsigned char c ) { return char( tolower( c ) ); } );
+	
+	return ( ext == program_info::jpg_ext ) || ( ext == "jpeg" ) || ( ext == program_info::pjg_ext );
+}
+
+void files::report( const std::string& name, const char* msg )
+{
+	// not a file to process, so it is shown right away
+	fprintf( stderr, "\nerror: %s (%s)\n", name.c_str(), msg );
+	errors++;
+}
+#endif
+
+/* ----------------------- End of main interface functions -------------------------- */
+
+/* ----------------------- Begin of main functions -------------------------- */
+
+
+/* -----------------------------------------------
+	check file and determine filetype
+	----------------------------------------------- */
+
+#if !defined(BUILD_LIB)
+static bool check_file()
+{	
+	unsigned char fileid[ 2 ] = { 0, 0 };
+	const std::string& filename = files::curr;
+	
+	
+	// open input stream, check for errors (files read ahead are open already)
+	if ( bgio::on && !pipe_on ) str_in = bgio::take( filename );
+	if ( str_in == nullptr ) {
+		if ( bgio::on && !pipe_on ) bgio::wait_written( filename );
+		str_in = new iostream( (void*) filename.c_str(), ( !pipe_on ) ? StreamType::kMapped : StreamType::kStream, 0, StreamMode::kRead );
+	}
+	if ( str_in->chkerr() ) {
+		sprintf( errormessage, FRD_ERRMSG.c_str(), filename.c_str());
+		errorlevel = 2;
+		return false;
+	}
+	// stdin is read again for verification, it has to be kept
+	if ( pipe_on && ( verify_lv > 0 ) ) str_in->retain();
+	
+	// free memory from filenames if needed
+	jpgfilename = "";
+	pjgfilename = "";
+	
+	// immediately return error if 2 bytes can't be read
+	if ( str_in->read( fileid, 2 ) != 2 ) { 
+		filetype = FileType::F_UNK;
+		sprintf( errormessage, "file doesn't contain enough data" );
+		errorlevel = 2;
+		return false;
+	}
+	
+	// check file id, determine filetype
+	if ( ( fileid[0] == 0xFF ) && ( fileid[1] == 0xD8 ) ) {
+		// file is JPEG
+		filetype = FileType::F_JPG;
+		// create filenames
+		if ( !pipe_on ) {
+			jpgfilename = filename;
+			pjgfilename = ( overwrite ) ?
+				create_filename( filename, program_info::pjg_ext ) :
+				unique_filename(filename, program_info::pjg_ext);
+		}
+		else {
+			jpgfilename = create_filename( "STDIN", "" );
+			pjgfilename = create_filename( "STDOUT", "" );
+		}
+		// open output stream, check for errors
+		str_out = open_output( pjgfilename, ( !pipe_on ) ? StreamType::kFile : StreamType::kStream );
+		if ( ( str_out == nullptr ) || str_out->chkerr() ) {
+			sprintf( errormessage, FWR_ERRMSG.c_str(), pjgfilename.c_str() );
+			errorlevel = 2;
+			return false;
+		}
+		// verification reads the output back
+		if ( verify_lv > 0 ) str_out->retain();
+		// JPEG specific settings - restore original settings
+		if ( orig_set[ 0 ] == 0 )
+			auto_set = true;
 		else {	
 			nois_trs[ 0 ] = orig_set[ 0 ];
 			nois_trs[ 1 ] = orig_set[ 1 ];
@@ -1909,13 +2895,14 @@ static bool check_file()
 			jpgfilename = create_filename( "STDOUT", "" );
 			pjgfilename = create_filename( "STDIN", "" );
 		}
-		// open output stream, check for errors
-		str_out = new iostream( (void*) jpgfilename.c_str(), ( !pipe_on ) ? StreamType::kFile : StreamType::kStream, 0, StreamMode::kWrite );
-		if ( str_out->chkerr() ) {
+		// open output stream, check for errors (mapped, its size is known from the PJG header)
+		str_out = open_output( jpgfilename, ( !pipe_on ) ? StreamType::kMapped : StreamType::kStream );
+		if ( ( str_out == nullptr ) || str_out->chkerr() ) {
 			sprintf( errormessage, FWR_ERRMSG.c_str(), jpgfilename.c_str());
 			errorlevel = 2;
 			return false;
 		}
+		if ( verify_lv > 0 ) str_out->retain();
 		// PJG specific settings - auto unless specified otherwise
 		auto_set = true;
 	}
@@ -1931,6 +2918,29 @@ static bool check_file()
 	return true;
 }
 
+/* -----------------------------------------------
+	open output stream, in memory if written behind
+	----------------------------------------------- */
+
+static iostream* open_output( const std::string& name, StreamType type )
+{
+	if ( !pipe_on ) files::written.insert( name );
+	if ( !bgio::on || pipe_on )
+		return new iostream( (void*) name.c_str(), type, 0, StreamMode::kWrite );
+	
+	// the file is created right away, names of later files stay unique
+	bgio::forget( name );
+	// mapped outputs are written back by the system already
+	if ( type == StreamType::kMapped ) {
+		bgio::wait_written( name );
+		return new iostream( (void*) name.c_str(), type, 0, StreamMode::kWrite );
+	}
+	bgio::out = fopen( name.c_str(), "wb" );
+	if ( bgio::out == nullptr ) return nullptr;
+	
+	return new iostream( nullptr, StreamType::kMemory, 0, StreamMode::kWrite );
+}
+
 /* -----------------------------------------------
 	swap streams / init verification
 	----------------------------------------------- */
@@ -1969,8 +2979,9 @@ static bool compare_output()
 	unsigned char* buff_ori;
 	unsigned char* buff_cmp;
 	int bsize = 1024;
-	int dsize;
-	int i, b;
+	std::size_t dsize;
+	std::size_t i;
+	int b;
 	
 	
 	// init buffer arrays
@@ -2014,7 +3025,7 @@ static bool compare_output()
 			str_out->read( buff_cmp, bsize );
 		}
 		if ( buff_ori[ b ] != buff_cmp[ b ] ) {
-			sprintf( errormessage, "difference found at 0x%X", i );
+			sprintf( errormessage, "difference found at 0x%llX", (unsigned long long) i );
 			errorlevel = 2;
 			return false;
 		}
@@ -2030,6 +3041,127 @@ static bool compare_output()
 #endif
 
 
+/* -----------------------------------------------
+	pooled storage for per image buffers
+	----------------------------------------------- */
+
+bool arena::reserve(std::size_t size) {
+	if (size <= arena::capacity) {
+		return true;
+	}
+	free(arena::raw);
+	// fresh memory comes zeroed, its pages are not touched before they are used
+	arena::raw = (unsigned char*) calloc(size + arena::alignment, 1);
+	if (arena::raw == nullptr) {
+		arena::base = nullptr;
+		arena::capacity = 0;
+		return false;
+	}
+	const auto addr = reinterpret_cast<std::uintptr_t>(arena::raw);
+	arena::base = arena::raw + (arena::aligned(addr) - addr);
+	arena::capacity = size;
+	arena::used = 0;
+	arena::dirty = 0;
+	return true;
+}
+
+template <class T> T* arena::take(std::size_t n) {
+	const std::size_t size = arena::aligned(n * sizeof(T));
+	if (arena::used + size > arena::capacity) {
+		return nullptr;
+	}
+	unsigned char* ptr = arena::base + arena::used;
+	if (arena::used < arena::dirty) {
+		std::fill(ptr, ptr + std::min(size, arena::dirty - arena::used), static_cast<unsigned char>(0));
+	}
+	arena::used += size;
+	arena::dirty = std::max(arena::dirty, arena::used);
+	return reinterpret_cast<T*>(ptr);
+}
+
+void arena::rewind() {
+	arena::used = 0;
+}
+
+
+/* -----------------------------------------------
+	estimates peak memory for the current file
+	----------------------------------------------- */
+
+static std::size_t estimate_memory(std::size_t* per_row)
+{
+	constexpr std::size_t model_mem = 1 << 20; // allowance for statistical models & small buffers
+	
+	// image arrays per mcu row, plus temporary context storage of the coefficient coders
+	std::size_t row_mem = 0;
+	std::size_t tmp_mem = 0;
+	for ( int cmp = 0; cmp < image::cmpc; cmp++ ) {
+		const std::size_t blocks = std::size_t( cmpnfo[ cmp ].sfh ) * cmpnfo[ cmp ].bch;
+		row_mem += blocks * ( 64 * sizeof( short ) + 5 * sizeof( char ) );
+		tmp_mem = std::max( tmp_mem, blocks * ( sizeof( std::uint16_t ) + 2 * sizeof( std::uint8_t ) + sizeof( int ) ) );
+	}
+	(*per_row) = row_mem + tmp_mem;
+	
+	// coded image data, header & garbage, in memory streams
+	std::size_t mem = model_mem;
+	mem += std::max( huffdata.size(), jpg::scan_size );
+	mem += hdrs + grbgdata.size();
+	// (stdin is not read ahead for its size, the part read so far is used)
+	const std::size_t in_size = str_in->getread();
+	mem += str_in->memsize();
+	if ( str_out->inmemory() )
+		mem += ( filetype == FileType::F_JPG ) ? jpgfilesize : std::max( jpg::out_size, in_size );
+	#if !defined(BUILD_LIB)
+	if ( verify_lv > 0 ) mem += 2 * ( ( filetype == FileType::F_JPG ) ? jpgfilesize : std::max( jpg::out_size, in_size ) );
+	#endif
+	
+	return mem;
+}
+
+/* -----------------------------------------------
+	drops stored sizes that don't fit the image
+	----------------------------------------------- */
+
+static void check_size_hints()
+{
+	// sizes from the PJG header are hints for preallocation only, they are
+	// dropped unless they fit the header, the image dimensions & the input
+	if ( ( jpg::out_size == 0 ) && ( jpg::scan_size == 0 ) ) return;
+	std::size_t blocks = 0;
+	for ( int cmp = 0; cmp < image::cmpc; cmp++ )
+		blocks += cmpnfo[ cmp ].bc;
+	std::size_t scans = 0;
+	for ( const auto& hseg : jpg::hdrsegs )
+		if ( hseg.type == 0xDA ) scans++;
+	// no more than 32 bits per coefficient, doubled by stuffing, plus a RST marker per mcu
+	const std::size_t scan_max = scans * ( blocks * 64 * 4 * 2 + std::size_t( image::mcuc ) * 2 + 16 );
+	// garbage is bounded by the input read so far, compressed garbage may exceed that
+	const std::size_t in_size = str_in->getread();
+	if ( ( jpg::scan_size == 0 ) || ( jpg::scan_size > scan_max ) ||
+		 ( jpg::out_size < 4 + hdrs + jpg::scan_size ) ||
+		 ( jpg::out_size > 4 + hdrs + jpg::scan_size + in_size ) ) {
+		jpg::out_size = 0;
+		jpg::scan_size = 0;
+	}
+}
+
+/* -----------------------------------------------
+	samples the memory held between processing steps
+	----------------------------------------------- */
+
+static void sample_memory()
+{
+	// called after each step only, so temporary buffers inside a step are
+	// missed, the result is an estimate of the peak from below
+	std::size_t mem = arena::used + huffdata.capacity() + grbgdata.capacity() + hdrs;
+	for ( iostream* str : { str_in, str_out } )
+		if ( str != nullptr ) mem += str->memsize();
+	#if !defined(BUILD_LIB)
+	if ( str_str != nullptr ) mem += str_str->memsize();
+	#endif
+	mem_sampled = std::max( mem_sampled, mem );
+}
+
 /* -----------------------------------------------
 	set each variable to its initial value
 	----------------------------------------------- */
@@ -2047,17 +3179,21 @@ static bool reset_buffers()
 	huffdata.clear();
 	grbgdata.clear();
 	jpg::rst_err.clear();
-	jpg::rstp.clear();
+	jpg::stuffed = false;
+	jpg::scan_size = 0;
+	jpg::out_size = 0;
+	jpg::streamed = false;
+	jpg::soi_out = false;
+	jpg::hdr_out = 0;
+	std::vector<std::uint8_t>().swap( jpg::prescanned );
+	jpg::prescan_pos = 0;
 	jpg::scnp.clear();
+	jpg::hdrsegs.clear();
 	hdrdata   = nullptr;
 	
-	// free image arrays
+	// release image arrays, their memory is kept in the arena
+	arena::rewind();
 	for ( cmp = 0; cmp < 4; cmp++ )	{
-		if ( pjg::zdstdata[ cmp ] != nullptr ) free( pjg::zdstdata[cmp] );
-		if ( pjg::eobxhigh[ cmp ] != nullptr) free( pjg::eobxhigh[cmp] );
-		if ( pjg::eobyhigh[ cmp ] != nullptr) free( pjg::eobyhigh[cmp] );
-		if ( pjg::zdstxlow[ cmp ] != nullptr) free( pjg::zdstxlow[cmp] );
-		if ( pjg::zdstylow[ cmp ] != nullptr) free( pjg::zdstylow[cmp] );
 		pjg::zdstdata[ cmp ] = nullptr;
 		pjg::eobxhigh[ cmp ] = nullptr;
 		pjg::eobyhigh[ cmp ] = nullptr;
@@ -2066,7 +3202,6 @@ static bool reset_buffers()
 		pjg::freqscan[ cmp ] = (unsigned char*) stdscan.data();
 		
 		for ( bpos = 0; bpos < 64; bpos++ ) {
-			if ( dct::colldata[ cmp ][ bpos ] != nullptr ) free( dct::colldata[cmp][bpos] );
 			dct::colldata[ cmp ][ bpos ] = nullptr;
 		}		
 	}
@@ -2123,6 +3258,90 @@ static bool reset_buffers()
 	return true;
 }
 	
+bool jpg::decode::prescan()
+{
+	// all data read here is kept for read(), nothing is read twice
+	std::vector<std::uint8_t>& data = jpg::prescanned;
+	const auto fetch = [ &data ]( std::size_t size ) {
+		const std::size_t pos = data.size();
+		data.resize( pos + size );
+		const std::size_t got = str_in->read( data.data() + pos, size );
+		data.resize( pos + got );
+		return got == size;
+	};
+	bool sof_found = false;
+	
+	// header reader loop, leave at the first SOS
+	while ( true ) {
+		const std::size_t pos = data.size(); // start of current segment
+		
+		// read in next marker
+		if ( !fetch( 2 ) ) {
+			sprintf( errormessage, "unexpected end of data encountered in header" );
+			errorlevel = 2;
+			return false;
+		}
+		// anything unusual is left to the reader routine and its fixes
+		if ( data[ pos ] != 0xFF ) break;
+		
+		const unsigned char type = data[ pos + 1 ]; // type of current marker segment
+		if ( type == 0xDA ) {
+			if ( !sof_found ) {
+				sprintf( errormessage, "header contains incomplete information" );
+				errorlevel = 2;
+				return false;
+			}
+			break;
+		}
+		else if ( type == 0xD9 ) {
+			sprintf( errormessage, "unexpected end of data encountered" );
+			errorlevel = 2;
+			return false;
+		}
+		
+		// read in segment length and data
+		if ( !fetch( 2 ) ) {
+			sprintf( errormessage, "unexpected end of data encountered in header" );
+			errorlevel = 2;
+			return false;
+		}
+		const unsigned int len = 2 + pack( data[ pos + 2 ], data[ pos + 3 ] ); // length of current marker segment
+		if ( len < 4 ) break;
+		if ( !fetch( len - 4 ) ) {
+			sprintf( errormessage, "unexpected end of data encountered in header" );
+			errorlevel = 2;
+			return false;
+		}
+		
+		// check frame type & fields, the header is parsed later on
+		if ( ( type >= 0xC0 ) && ( type <= 0xCF ) &&
+			( type != 0xC4 ) && ( type != 0xC8 ) && ( type != 0xCC ) ) {
+			if ( !jpg::jfif::check_sof( type, len, &( data[ pos ] ) ) )
+				return false;
+			sof_found = true;
+		}
+	}
+	
+	
+	return true;
+}
+
+std::size_t jpg::decode::read_hdr( unsigned char* to, std::size_t size )
+{
+	std::size_t done = 0;
+	
+	// data read by prescan() comes first
+	if ( jpg::prescan_pos < jpg::prescanned.size() ) {
+		done = std::min( size, jpg::prescanned.size() - jpg::prescan_pos );
+		std::copy_n( jpg::prescanned.data() + jpg::prescan_pos, done, to );
+		jpg::prescan_pos += done;
+	}
+	if ( done < size )
+		done += str_in->read( to + done, size - done );
+	
+	return done;
+}
+
 bool jpg::decode::read()
 {
 	unsigned char  type = 0x00; // type of current marker segment
@@ -2212,13 +3431,13 @@ bool jpg::decode::read()
 		}
 		else {
 			// read in next marker
-			if ( str_in->read( segment.data(), 2 ) != 2 ) break;
+			if ( jpg::decode::read_hdr( segment.data(), 2 ) != 2 ) break;
 			if ( segment[ 0 ] != 0xFF ) {
 				// ugly fix for incorrect marker segment sizes
 				sprintf( errormessage, "size mismatch in marker segment FF %2X", type );
 				errorlevel = 2;
 				if ( type == 0xFE ) { //  if last marker was COM try again
-					if ( str_in->read( segment.data(), 2 ) != 2 ) break;
+					if ( jpg::decode::read_hdr( segment.data(), 2 ) != 2 ) break;
 					if ( segment[ 0 ] == 0xFF ) errorlevel = 1;
 				}
 				if ( errorlevel == 2 ) {
@@ -2235,16 +3454,21 @@ bool jpg::decode::read()
 			// get pointer for header data & size
 			hdrdata  = hdrw->getptr();
 			hdrs     = hdrw->getpos();
-			// get pointer for huffman data & size
-			auto hdata = huffw->getptr();
-			auto hdata_length = huffw->getpos();
-			huffdata = std::vector<std::uint8_t>(hdata, hdata + hdata_length);
+			if ( !jpg::index_header() ) return false;
+			// whatever is not SOI, EOI or header is scan data
+			jpg::scan_size = str_in->getpos() - 4 - hdrs;
+			// copy huffman data blockwise
+			huffdata.clear();
+			huffdata.reserve( huffw->getpos() );
+			huffw->for_each_chunk( []( const unsigned char* chunk, std::size_t size ) {
+				huffdata.insert( huffdata.end(), chunk, chunk + size );
+			} );
 			// everything is done here now
 			break;			
 		}
 		
 		// read in next segments' length and check it
-		if ( str_in->read( segment.data() + 2, 2 ) != 2 ) break;
+		if ( jpg::decode::read_hdr( segment.data() + 2, 2 ) != 2 ) break;
 		len = 2 + pack( segment[ 2 ], segment[ 3 ] );
 		if ( len < 4 ) break;
 		
@@ -2254,7 +3478,7 @@ bool jpg::decode::read()
 		}
 		
 		// read rest of segment, store back in header writer
-		if ( str_in->read( ( segment.data() + 4 ), ( len - 4 ) ) !=
+		if ( jpg::decode::read_hdr( ( segment.data() + 4 ), ( len - 4 ) ) !=
 			( unsigned short ) ( len - 4 ) ) break;
 		hdrw->write_n( segment.data(), len );
 	}
@@ -2273,14 +3497,17 @@ bool jpg::decode::read()
 
 		auto grbgw = std::make_unique<abytewriter>( 1024 );
 		grbgw->write( tmp );
+		// read in large blocks, stdin & callbacks can fill them directly
+		std::vector<std::uint8_t> block( 1 << 16 );
 		while( true ) {
-			len = str_in->read( segment.data(), segment.capacity() );
-			if ( len == 0 ) break;
-			grbgw->write_n( segment.data(), len );
+			const std::size_t got = str_in->read( block.data(), block.size() );
+			if ( got == 0 ) break;
+			grbgw->write_n( block.data(), got );
 		}
-		auto grbgptr = grbgw->getptr();
-		auto grbg_size = grbgw->getpos();
-		grbgdata = std::vector<std::uint8_t>(grbgptr, grbgptr + grbg_size);
+		grbgdata.reserve( grbgw->getpos() );
+		grbgw->for_each_chunk( []( const unsigned char* chunk, std::size_t size ) {
+			grbgdata.insert( grbgdata.end(), chunk, chunk + size );
+		} );
 	}
 	
 	// get filesize
@@ -2296,28 +3523,29 @@ bool jpg::decode::read()
 }
 
 bool jpg::encode::merge() {
-	int hpos = 0; // current position in header
-	int rpos = 0; // current restart marker position
+	std::size_t seg = 0; // current segment in header
+	std::size_t hpos = 0; // current position in header
 	int scan = 1; // number of current scan	
 
-	// write SOI
-	constexpr std::array<std::uint8_t, 2> SOI = {0xFF, 0xD8};
-	str_out->write(SOI.data(), 2);
+	// streamed output: only the header after the last scan is left
+	if (jpg::streamed) {
+		jpg::encode::write_header(hdrs);
+	} else {
+		// write SOI
+		constexpr std::array<std::uint8_t, 2> SOI = {0xFF, 0xD8};
+		str_out->write(SOI.data(), 2);
+	}
 
 	// JPEG writing loop
-	while (true) {
+	while (!jpg::streamed) {
 		// store current header position
-		std::uint32_t tmp = hpos;
+		std::size_t tmp = hpos;
 
 		// seek till start-of-scan
 		std::uint8_t type; // type of current marker segment
-		for (type = 0x00; type != 0xDA;) {
-			if (hpos >= hdrs) {
-				break;
-			}
-			type = hdrdata[hpos + 1];
-			int len = 2 + pack( hdrdata[ hpos + 2 ], hdrdata[ hpos + 3 ] ); // length of current marker segment
-			hpos += len;
+		for (type = 0x00; (type != 0xDA) && (seg < jpg::hdrsegs.size()); seg++) {
+			type = jpg::hdrsegs[seg].type;
+			hpos = jpg::hdrsegs[seg].pos + jpg::hdrsegs[seg].len;
 		}
 
 		// write header data to file
@@ -2328,42 +3556,8 @@ bool jpg::encode::merge() {
 			break;
 		}
 
-
-		// (re)set corrected rst pos
-		std::uint32_t cpos = 0; // in scan corrected rst marker position
-
-		// write & expand huffman coded image data
-		// ipos is the current position in image data.
-		for (std::uint32_t ipos = jpg::scnp[scan - 1]; ipos < jpg::scnp[scan]; ipos++) {
-			// write current byte
-			str_out->write_byte(huffdata[ipos]);
-			// check current byte, stuff if needed
-			if (huffdata[ipos] == 0xFF) {
-				str_out->write_byte(std::uint8_t(0)); // 0xFF stuff value
-			}
-			// insert restart markers if needed
-			if (!jpg::rstp.empty()) {
-				if (ipos == jpg::rstp[rpos]) {
-					const std::uint8_t rst = 0xD0 + (cpos % 8); // Restart marker
-					constexpr std::uint8_t mrk = 0xFF; // marker start
-					str_out->write_byte(mrk);
-					str_out->write_byte(rst);
-					rpos++;
-					cpos++;
-				}
-			}
-		}
-		// insert false rst markers at end if needed
-		if (!jpg::rst_err.empty()) {
-			while (jpg::rst_err[scan - 1] > 0) {
-				const std::uint8_t rst = 0xD0 + (cpos % 8); // Restart marker
-				constexpr std::uint8_t mrk = 0xFF; // marker start
-				str_out->write_byte(mrk);
-				str_out->write_byte(rst);
-				cpos++;
-				jpg::rst_err[scan - 1]--;
-			}
-		}
+		// write huffman coded image data, recode() did stuffing and markers already
+		str_out->write(huffdata.data() + jpg::scnp[scan - 1], jpg::scnp[scan] - jpg::scnp[scan - 1]);
 
 		// proceed with next scan
 		scan++;
@@ -2391,11 +3585,33 @@ bool jpg::encode::merge() {
 	return true;
 }
 
+void jpg::encode::write_header(std::size_t hpos) {
+	// write SOI first
+	if (!jpg::soi_out) {
+		constexpr std::array<std::uint8_t, 2> SOI = {0xFF, 0xD8};
+		str_out->write(SOI.data(), 2);
+		jpg::soi_out = true;
+	}
+	if (hpos > jpg::hdr_out) {
+		str_out->write(hdrdata + jpg::hdr_out, hpos - jpg::hdr_out);
+		jpg::hdr_out = hpos;
+	}
+}
+
+void jpg::encode::stream_out(const std::unique_ptr<abitwriter>& huffw) {
+	if (jpg::streamed) {
+		huffw->drain([](const unsigned char* chunk, std::size_t size) {
+			str_out->write(chunk, size);
+		});
+	}
+}
+
 bool jpg::decode::decode()
 {	
-	unsigned int hpos = 0; // current position in header
+	std::size_t seg = 0; // current segment in header
 	
 	short block[64]; // store block for coeffs
+	auto tile = std::make_unique<jpg::BlockTile>(); // block-major staging for sequential & AC scans
 	
 	// open huffman coded image data for input in abitreader
 	auto huffr = std::make_unique<abitreader>(huffdata.data(), huffdata.size()); // bitwise reader for image data
@@ -2406,18 +3622,13 @@ bool jpg::decode::decode()
 	// JPEG decompression loop
 	while ( true )
 	{
-		// seek till start-of-scan, parse only DHT, DRI and SOS
+		// seek till start-of-scan, use only DHT, DRI and SOS
 		std::uint8_t type; // type of current marker segment
-		for ( type = 0x00; type != 0xDA; ) {
-			if ( ( int ) hpos >= hdrs ) break;
-			type = hdrdata[ hpos + 1 ];
-			std::uint32_t len = 2 + pack( hdrdata[ hpos + 2 ], hdrdata[ hpos + 3 ] ); // length of current marker segment
-			if ( ( type == 0xC4 ) || ( type == 0xDA ) || ( type == 0xDD ) ) {
-				if ( !jpg::jfif::parse_jfif( type, len, &( hdrdata[ hpos ] ) ) ) {
-					return false;
-				}
+		for ( type = 0x00; ( type != 0xDA ) && ( seg < jpg::hdrsegs.size() ); seg++ ) {
+			if ( !jpg::jfif::use_segment( jpg::hdrsegs[ seg ] ) ) {
+				return false;
 			}
-			hpos += len;
+			type = jpg::hdrsegs[ seg ].type;
 		}
 		
 		// get out if last marker segment type was not SOS
@@ -2464,31 +3675,8 @@ bool jpg::decode::decode()
 			{				
 				if ( jpegtype == JpegType::SEQUENTIAL ) {
 					// ---> sequential interleaved decoding <---
-					while ( status == jpg::CodingStatus::OKAY ) {
-						// decode block
-						eob = jpg::decode::block_seq( huffr,
-						                              jpg::htrees[ 0 ][ cmpnfo[cmp].huffdc ],
-						                              jpg::htrees[ 1 ][ cmpnfo[cmp].huffdc ],
-						                              block );
-						
-						// check for non optimal coding
-						if ( ( eob > 1 ) && ( block[ eob - 1 ] == 0 ) ) {
-							sprintf( errormessage, "reconstruction of inefficient coding not supported" );
-							errorlevel = 1;
-						}
-						
-						// fix dc
-						block[ 0 ] += lastdc[ cmp ];
-						lastdc[ cmp ] = block[ 0 ];
-						
-						// copy to dct::colldata
-						for (int bpos = 0; bpos < eob; bpos++ )
-							dct::colldata[ cmp ][ bpos ][ dpos ] = block[ bpos ];
-						
-						// check for errors, proceed if no error encountered
-						if ( eob < 0 ) status = jpg::CodingStatus::ERROR;
-						else status = jpg::next_mcupos(&mcu, &cmp, &csc, &sub, &dpos, &rstw);
-					}
+					while ( status == jpg::CodingStatus::OKAY )
+						status = jpg::decode::seq_tile( huffr, *tile, lastdc, &mcu, &cmp, &csc, &sub, &dpos, &rstw );
 				}
 				else if ( curr_scan::sah == 0 ) {
 					// ---> progressive interleaved DC decoding <---
@@ -2525,34 +3713,11 @@ bool jpg::decode::decode()
 				}
 			}
 			else // decoding for non interleaved data
-			{
-				if ( jpegtype == JpegType::SEQUENTIAL ) {
-					// ---> sequential non interleaved decoding <---
-					while ( status == jpg::CodingStatus::OKAY ) {
-						// decode block
-						eob = jpg::decode::block_seq( huffr,
-						                              jpg::htrees[ 0 ][ cmpnfo[cmp].huffdc ],
-						                              jpg::htrees[ 1 ][ cmpnfo[cmp].huffdc ],
-						                              block );
-						
-						// check for non optimal coding
-						if ( ( eob > 1 ) && ( block[ eob - 1 ] == 0 ) ) {
-							sprintf( errormessage, "reconstruction of inefficient coding not supported" );
-							errorlevel = 1;
-						}
-						
-						// fix dc
-						block[ 0 ] += lastdc[ cmp ];
-						lastdc[ cmp ] = block[ 0 ];
-						
-						// copy to dct::colldata
-						for (int bpos = 0; bpos < eob; bpos++ )
-							dct::colldata[ cmp ][ bpos ][ dpos ] = block[ bpos ];
-						
-						// check for errors, proceed if no error encountered
-						if ( eob < 0 ) status = jpg::CodingStatus::ERROR;
-						else status = jpg::next_mcuposn(cmp, &dpos, &rstw);
-					}
+			{
+				if ( jpegtype == JpegType::SEQUENTIAL ) {
+					// ---> sequential non interleaved decoding <---
+					while ( status == jpg::CodingStatus::OKAY )
+						status = jpg::decode::seq_tile( huffr, *tile, lastdc, &mcu, &cmp, &csc, &sub, &dpos, &rstw );
 				}
 				else if ( curr_scan::to == 0 ) {					
 					if ( curr_scan::sah == 0 ) {
@@ -2594,12 +3759,14 @@ bool jpg::decode::decode()
 					if ( curr_scan::sah == 0 ) {
 						// ---> progressive non interleaved AC decoding <---
 						// ---> succesive approximation first stage <---
+						tile->count = 0;
 						while ( status == jpg::CodingStatus::OKAY ) {
 							if ( eobrun == 0 ) {
 								// decode block
+								auto& tblock = tile->block[ tile->count ];
 								eob = jpg::decode::ac_prg_fs( huffr,
 								                              jpg::htrees[1][cmpnfo[cmp].huffac],
-								                              block, &eobrun, curr_scan::from, curr_scan::to );
+								                              tblock.data(), &eobrun, curr_scan::from, curr_scan::to );
 								
 								if ( eobrun > 0 ) {
 									// check for non optimal coding
@@ -2613,9 +3780,18 @@ bool jpg::decode::decode()
 									eobrun--;
 								} else peobrun = 0;
 							
-								// copy to colldata
-								for (int bpos = curr_scan::from; bpos < eob; bpos++)
-									dct::colldata[ cmp ][ bpos ][ dpos ] = block[ bpos ] << curr_scan::sal;
+								// bitshift for succesive approximation, store in tile
+								if ( eob > curr_scan::from ) {
+									for (int bpos = curr_scan::from; bpos < eob; bpos++)
+										tblock[ bpos ] <<= curr_scan::sal;
+									tile->eob[ tile->count ] = eob;
+									tile->cmp[ tile->count ] = cmp;
+									tile->dpos[ tile->count++ ] = dpos;
+									if ( tile->count == jpg::BlockTile::capacity ) {
+										jpg::tile_scatter( *tile, curr_scan::from );
+										tile->count = 0;
+									}
+								}
 							} else eobrun--;
 							
 							// check for errors
@@ -2626,16 +3802,19 @@ bool jpg::decode::decode()
 							if ( status == jpg::CodingStatus::OKAY )
 								status = jpg::next_mcuposn(cmp, &dpos, &rstw);
 						}
+						
+						// copy remaining blocks to colldata
+						jpg::tile_scatter( *tile, curr_scan::from );
 					}
 					else {
 						// ---> progressive non interleaved AC decoding <---
 						// ---> succesive approximation later stage <---
 						while ( status == jpg::CodingStatus::OKAY ) {
-							// copy from colldata
-							for (int bpos = curr_scan::from; bpos <= curr_scan::to; bpos++)
-								block[ bpos ] = dct::colldata[ cmp ][ bpos ][ dpos ];
-							
 							if ( eobrun == 0 ) {
+								// copy from colldata
+								for (int bpos = curr_scan::from; bpos <= curr_scan::to; bpos++)
+									block[ bpos ] = dct::colldata[ cmp ][ bpos ][ dpos ];
+								
 								// decode block (long routine)
 								eob = jpg::decode::ac_prg_sa( huffr,
 								                              jpg::htrees[1][cmpnfo[cmp].huffac],
@@ -2656,10 +3835,16 @@ bool jpg::decode::decode()
 								} else peobrun = 0;
 							}
 							else {
-								// decode block (short routine)
-								jpg::decode::eobrun_sa(huffr, block, &eobrun, curr_scan::from, curr_scan::to);
-								eob = 0;
-								eobrun--;
+								// collect the blocks of the eobrun, refine them in bulk (short routine)
+								tile->count = 0;
+								do {
+									tile->dpos[ tile->count++ ] = dpos;
+									eobrun--;
+									status = jpg::next_mcuposn(cmp, &dpos, &rstw);
+								} while ( ( eobrun > 0 ) && ( status == jpg::CodingStatus::OKAY ) &&
+									( tile->count < jpg::BlockTile::capacity ) );
+								jpg::decode::eobrun_sa( huffr, *tile, cmp, curr_scan::from, curr_scan::to );
+								continue;
 							}
 								
 							// copy back to colldata
@@ -2718,64 +3903,56 @@ bool jpg::decode::decode()
 
 bool jpg::encode::recode()
 {	
-	int hpos = 0; // current position in header
+	std::size_t seg = 0; // current segment in header
 	
 	std::array<std::int16_t, 64> block; // store block for coeffs
+	auto tile = std::make_unique<jpg::BlockTile>(); // block-major staging for sequential & AC scans
 	
 	// open huffman coded image data in abitwriter
-	auto huffw = std::make_unique<abitwriter>(0); // bitwise writer for image data
+	// write stuffed scans with RST markers right away, unless raw data is dumped
+	jpg::stuffed = ( action != Action::A_SPLIT_DUMP );
+	jpg::streamed = jpg::streamed && jpg::stuffed;
+	
+	// streamed output needs only a small buffer between flushes
+	auto huffw = std::make_unique<abitwriter>( jpg::streamed ? 0 : jpg::scan_size + 16 ); // bitwise writer for image data
 	huffw->set_fillbit( jpg::padbit );
+	huffw->set_stuffing( jpg::stuffed );
 	
 	// init storage writer
 	auto storw = std::make_unique<abytewriter>(0); // bytewise writer for storage of correction bits
 	
 	// preset count of scans and restarts
 	jpg::scan_count = 0;
-	int rstc = 0; // count of restart markers
 	
 	// JPEG decompression loop
 	while ( true )
 	{
-		// seek till start-of-scan, parse only DHT, DRI and SOS
+		// seek till start-of-scan, use only DHT, DRI and SOS
 		std::uint8_t type; // type of current marker segment
-		for ( type = 0x00; type != 0xDA; ) {
-			if (hpos >= hdrs) {
-				break;
-			}
-			type = hdrdata[ hpos + 1 ];
-			std::uint32_t len = 2 + pack( hdrdata[ hpos + 2 ], hdrdata[ hpos + 3 ] ); // length of current marker segment
-			if ( ( type == 0xC4 ) || ( type == 0xDA ) || ( type == 0xDD ) ) {
-				if ( !jpg::jfif::parse_jfif( type, len, &( hdrdata[ hpos ] ) ) ) {
-					return false;
-				}
-				hpos += len;
+		for ( type = 0x00; ( type != 0xDA ) && ( seg < jpg::hdrsegs.size() ); seg++ ) {
+			if ( !jpg::jfif::use_segment( jpg::hdrsegs[ seg ] ) ) {
+				return false;
 			}
-			else {
-				hpos += len;
-				continue;
-			}			
+			type = jpg::hdrsegs[ seg ].type;
 		}
 		
 		// get out if last marker segment type was not SOS
 		if ( type != 0xDA ) break;
 		
+		// streamed output: header segments up to this SOS go first
+		if ( jpg::streamed )
+			jpg::encode::write_header( jpg::hdrsegs[ seg - 1 ].pos + jpg::hdrsegs[ seg - 1 ].len );
 		
 		// (re)alloc scan positons array
 		jpg::scnp.resize(jpg::scan_count + 2);
 		
-		// (re)alloc restart marker positons array if needed
-		if ( jpg::rsti > 0 ) {
-			int tmp = rstc + ( ( curr_scan::cmpc > 1 ) ?
-				( image::mcuc / jpg::rsti ) : ( cmpnfo[ curr_scan::cmp[ 0 ] ].bc / jpg::rsti ) );
-			jpg::rstp.resize(tmp + 1);
-		}		
-		
 		// intial variables set for encoding
 		int cmp  = curr_scan::cmp[ 0 ];
 		int csc  = 0;
 		int mcu  = 0;
 		int sub  = 0;
 		int dpos = 0;
+		int cpos = 0; // in scan restart marker count
 		
 		// store scan position
 		jpg::scnp[ jpg::scan_count ] = huffw->getpos();
@@ -2801,23 +3978,8 @@ bool jpg::encode::recode()
 				if ( jpegtype == JpegType::SEQUENTIAL ) {
 					// ---> sequential interleaved encoding <---
 					while ( status == jpg::CodingStatus::OKAY ) {
-						// copy from colldata
-						for (int bpos = 0; bpos < 64; bpos++)
-							block[ bpos ] = dct::colldata[ cmp ][ bpos ][ dpos ];
-						
-						// diff coding for dc
-						block[ 0 ] -= lastdc[ cmp ];
-						lastdc[ cmp ] = dct::colldata[ cmp ][ 0 ][ dpos ];
-						
-						// encode block
-						int eob = jpg::encode::block_seq( huffw,
-						                              jpg::hcodes[0][cmpnfo[cmp].huffdc],
-						                              jpg::hcodes[1][cmpnfo[cmp].huffac],
-						                              block );
-						
-						// check for errors, proceed if no error encountered
-						if ( eob < 0 ) status = jpg::CodingStatus::ERROR;
-						else status = jpg::next_mcupos( &mcu, &cmp, &csc, &sub, &dpos, &rstw );
+						status = jpg::encode::seq_tile( huffw, *tile, lastdc, &mcu, &cmp, &csc, &sub, &dpos, &rstw );
+						jpg::encode::stream_out( huffw );
 					}
 				}
 				else if ( curr_scan::sah == 0 ) {
@@ -2857,23 +4019,8 @@ bool jpg::encode::recode()
 				if ( jpegtype == JpegType::SEQUENTIAL ) {
 					// ---> sequential non interleaved encoding <---
 					while ( status == jpg::CodingStatus::OKAY ) {
-						// copy from colldata
-						for (int bpos = 0; bpos < 64; bpos++)
-							block[ bpos ] = dct::colldata[ cmp ][ bpos ][ dpos ];
-						
-						// diff coding for dc
-						block[ 0 ] -= lastdc[ cmp ];
-						lastdc[ cmp ] = dct::colldata[ cmp ][ 0 ][ dpos ];
-						
-						// encode block
-						int eob = jpg::encode::block_seq( huffw,
-						                              jpg::hcodes[0][cmpnfo[cmp].huffdc],
-						                              jpg::hcodes[1][cmpnfo[cmp].huffac],
-						                              block );
-						
-						// check for errors, proceed if no error encountered
-						if ( eob < 0 ) status = jpg::CodingStatus::ERROR;
-						else status = jpg::next_mcuposn(cmp, &dpos, &rstw);	
+						status = jpg::encode::seq_tile( huffw, *tile, lastdc, &mcu, &cmp, &csc, &sub, &dpos, &rstw );
+						jpg::encode::stream_out( huffw );
 					}
 				}
 				else if ( curr_scan::to == 0 ) {
@@ -2915,19 +4062,31 @@ bool jpg::encode::recode()
 						// ---> progressive non interleaved AC encoding <---
 						// ---> succesive approximation first stage <---
 						while ( status == jpg::CodingStatus::OKAY ) {
-							// copy from colldata
-							for (int bpos = curr_scan::from; bpos <= curr_scan::to; bpos++)
-								block[ bpos ] =
-									fdiv2(dct::colldata[ cmp ][ bpos ][ dpos ], curr_scan::sal );
+							// collect positions for the next tile of blocks
+							for ( tile->count = 0; ( status == jpg::CodingStatus::OKAY ) &&
+								( tile->count < jpg::BlockTile::capacity ); ) {
+								tile->cmp[ tile->count ] = cmp;
+								tile->dpos[ tile->count++ ] = dpos;
+								status = jpg::next_mcuposn(cmp, &dpos, &rstw);
+							}
 							
-							// encode block
-							int eob = jpg::encode::ac_prg_fs( huffw,
-							                              jpg::hcodes[1][cmpnfo[cmp].huffac],
-							                              block, &eobrun, curr_scan::from, curr_scan::to );
+							// copy from colldata
+							jpg::tile_gather( *tile, curr_scan::from, curr_scan::to );
 							
-							// check for errors, proceed if no error encountered
-							if ( eob < 0 ) status = jpg::CodingStatus::ERROR;
-							else status = jpg::next_mcuposn(cmp, &dpos, &rstw);
+							for ( int i = 0; i < tile->count; i++ ) {
+								auto& tblock = tile->block[ i ];
+								for (int bpos = curr_scan::from; bpos <= curr_scan::to; bpos++)
+									tblock[ bpos ] = fdiv2( tblock[ bpos ], curr_scan::sal );
+								
+								// encode block
+								int eob = jpg::encode::ac_prg_fs( huffw,
+								                              jpg::hcodes[1][cmpnfo[cmp].huffac],
+								                              tblock, &eobrun, curr_scan::from, curr_scan::to );
+								
+								// check for errors
+								if ( eob < 0 ) status = jpg::CodingStatus::ERROR;
+							}
+							jpg::encode::stream_out( huffw );
 						}						
 						
 						// encode remaining eobrun
@@ -2972,12 +4131,19 @@ bool jpg::encode::recode()
 				return false;
 			}
 			else if ( status == jpg::CodingStatus::DONE ) {
+				// insert false rst markers at end if needed
+				if ( jpg::stuffed && ( jpg::scan_count < int( jpg::rst_err.size() ) ) ) {
+					for ( int i = 0; i < jpg::rst_err[ jpg::scan_count ]; i++ )
+						huffw->write_marker( 0xD0 + ( ( cpos++ ) % 8 ) );
+				}
+				jpg::encode::stream_out( huffw );
 				jpg::scan_count++; // increment scan counter
 				break; // leave decoding loop, everything is done here
 			}
 			else if ( status == jpg::CodingStatus::RESTART ) {
-				if ( jpg::rsti > 0 ) // store jpg::rstp & stay in the loop
-					jpg::rstp[ rstc++ ] = huffw->getpos() - 1;
+				if ( ( jpg::rsti > 0 ) && jpg::stuffed ) // write rst marker & stay in the loop
+					huffw->write_marker( 0xD0 + ( ( cpos++ ) % 8 ) );
+				jpg::encode::stream_out( huffw );
 			}
 		}
 	}
@@ -2989,17 +4155,18 @@ bool jpg::encode::recode()
 		return false;
 	}
 	
-	// get data into huffdata
-	auto hdata = huffw->getptr();
-	auto hdata_length = huffw->getpos();
-	huffdata = std::vector<std::uint8_t>(hdata, hdata + hdata_length);
-	
-	// store last scan & restart positions
-	jpg::scnp[ jpg::scan_count ] = huffdata.size();
-	if (!jpg::rstp.empty()) {
-		jpg::rstp[rstc] = huffdata.size();
+	// get data into huffdata, streamed data is in the output already
+	huffdata.clear();
+	if ( !jpg::streamed ) {
+		huffdata.reserve( huffw->getpos() );
+		huffw->for_each_chunk( []( const unsigned char* chunk, std::size_t size ) {
+			huffdata.insert( huffdata.end(), chunk, chunk + size );
+		} );
 	}
 	
+	// store last scan position
+	jpg::scnp[ jpg::scan_count ] = huffw->getpos();
+	
 	
 	return true;
 }
@@ -3202,6 +4369,24 @@ bool pjg::encode::encode()
 		str_out->write( segm_cnt, 4 );
 	}
 	
+	// discard meta information from header if option set
+	if ( disc_meta )
+		if ( !jpg::rebuild_header() ) return false;	
+	
+	// store sizes of reconstructed file and scans for preallocation
+	// (4 byte fields, not stored for files of 4GB and more)
+	if ( jpg::scan_size > 0 ) jpg::out_size = 4 + hdrs + jpg::scan_size + grbgdata.size();
+	if ( ( jpg::scan_size > 0 ) && ( jpg::out_size <= 0xFFFFFFFFu ) ) {
+		hcode = 0x01;
+		str_out->write_byte(hcode);
+		for ( std::size_t size : { jpg::out_size, jpg::scan_size } ) {
+			const std::array<std::uint8_t, 4> field = {
+				std::uint8_t( size >> 24 ), std::uint8_t( size >> 16 ),
+				std::uint8_t( size >> 8 ), std::uint8_t( size ) };
+			str_out->write( field.data(), 4 );
+		}
+	}
+	
 	// store version number
 	hcode = program_info::appversion;
 	str_out->write_byte(hcode);
@@ -3210,9 +4395,6 @@ bool pjg::encode::encode()
 	// init arithmetic compression
 	auto encoder = std::make_unique<aricoder>(str_out, StreamMode::kWrite);
 	
-	// discard meta information from header if option set
-	if ( disc_meta )
-		if ( !jpg::rebuild_header() ) return false;	
 	// optimize header for compression
 	pjg::encode::optimize_header();
 	// set padbit to 1 if previously unset
@@ -3324,6 +4506,13 @@ bool pjg::decode::decode()
 			str_in->read( segm_cnt, 4 );
 			auto_set = false;
 		}
+		else if ( hcode == 0x01 ) {
+			// retrieve sizes of JPEG file and scans
+			std::array<std::uint8_t, 8> field;
+			str_in->read( field.data(), 8 );
+			jpg::out_size = ( std::size_t( field[ 0 ] ) << 24 ) | ( field[ 1 ] << 16 ) | ( field[ 2 ] << 8 ) | field[ 3 ];
+			jpg::scan_size = ( std::size_t( field[ 4 ] ) << 24 ) | ( field[ 5 ] << 16 ) | ( field[ 6 ] << 8 ) | field[ 7 ];
+		}
 		else if ( hcode >= 0x14 ) {
 			// compare version number
 			if ( hcode != program_info::appversion ) {
@@ -3347,6 +4536,7 @@ bool pjg::decode::decode()
 	
 	// decode JPG header
 	if ( !pjg::decode::generic( decoder, &hdrdata, &hdrs ) ) return false;
+	if ( !jpg::index_header() ) return false;
 	// retrieve padbit from stream
 	jpg::padbit = pjg::decode::bit(decoder);
 	// decode one bit that signals false /correct use of RST markers
@@ -3361,8 +4551,23 @@ bool pjg::decode::decode()
 	// discard meta information from header if option set
 	if ( disc_meta )
 		if ( !jpg::rebuild_header() ) return false;
-	// parse header for image-info
+	// parse header for image-info, this also checks the stored sizes
 	if ( !jpg::setup_imginfo() ) return false;
+	// known output size: allocate once
+	if ( ( jpg::out_size > 0 ) && !disc_meta )
+		str_out->reserve( jpg::out_size );
+	// for regular decompression, output starts with the header up to the first SOS
+	jpg::streamed = ( action == Action::A_COMPRESS );
+	if ( jpg::streamed ) {
+		for ( const auto& hseg : jpg::hdrsegs ) {
+			if ( hseg.type == 0xDA ) {
+				jpg::encode::write_header( hseg.pos + hseg.len );
+				break;
+			}
+		}
+		// hand the header over right away if output goes to a pipe
+		str_out->flush();
+	}
 	
 	// decode actual components data
 	for ( cmp = 0; cmp < image::cmpc; cmp++ ) {
@@ -3405,23 +4610,21 @@ bool pjg::decode::decode()
 
 bool jpg::setup_imginfo()
 {
-	unsigned char  type; // type of current marker segment
-	unsigned int   len; // length of current marker segment
-	unsigned int   hpos = 0; // position in header
-	
 	int cmp, bpos;
 	int i;
 	
-	// header parser loop
-	while ( ( int ) hpos < hdrs ) {
-		type = hdrdata[ hpos + 1 ];
-		len = 2 + pack( hdrdata[ hpos + 2 ], hdrdata[ hpos + 3 ] );
-		// do not parse DHT & DRI
-		if ( ( type != 0xDA ) && ( type != 0xC4 ) && ( type != 0xDD ) ) {
-			if ( !jpg::jfif::parse_jfif( type, len, &( hdrdata[ hpos ] ) ) )
+	// header parser loop, huffman tables are built once here
+	for ( auto& hseg : jpg::hdrsegs ) {
+		if ( hseg.type == 0xC4 ) {
+			hseg.dht.clear();
+			if ( !jpg::jfif::parse_dht( hseg.len, &( hdrdata[ hseg.pos ] ), hseg.dht ) )
+				return false;
+		}
+		// do not parse SOS & DRI
+		else if ( ( hseg.type != 0xDA ) && ( hseg.type != 0xDD ) ) {
+			if ( !jpg::jfif::parse_jfif( hseg.type, hseg.len, &( hdrdata[ hseg.pos ] ) ) )
 				return false;
 		}
-		hpos += len;
 	}
 	
 	// check if information is complete
@@ -3470,12 +4673,48 @@ bool jpg::setup_imginfo()
 		for ( cmp = 0; cmp < image::cmpc; cmp++ ) cmpnfo[ cmp ].sid = 0;
 	}
 	
+	// also decide automatic settings here
+	if ( auto_set ) {
+		for ( cmp = 0; cmp < image::cmpc; cmp++ ) {
+			for ( i = 0;
+				conf_sets[ i ][ cmpnfo[cmp].sid ] > (unsigned int) cmpnfo[ cmp ].bc;
+				i++ );
+			segm_cnt[ cmp ] = conf_segm;
+			nois_trs[ cmp ] = conf_ntrs[ i ][ cmpnfo[cmp].sid ];
+		}
+	}
+	
+	// estimate peak memory, check sizes stored in PJGs first (JPEGs just read hold their scans already)
+	const bool from_jpg = !huffdata.empty();
+	if ( !from_jpg ) check_size_hints();
+	std::size_t row_mem;
+	const std::size_t fixed_mem = estimate_memory( &row_mem );
+	mem_estimate = fixed_mem + row_mem * image::mcuv;
+	if ( ( mem_limit > 0 ) && ( mem_estimate > ( std::size_t( mem_limit ) << 20 ) ) ) {
+		sprintf( errormessage, "memory limit of %i MB exceeded, about %i MB needed",
+			mem_limit, int( mem_estimate >> 20 ) + 1 );
+		errorlevel = 2;
+		return false;
+	}
+	
+	// reserve pooled memory for all image arrays at once
+	std::size_t arena_size = 0;
+	for ( cmp = 0; cmp < image::cmpc; cmp++ ) {
+		arena_size += 64 * arena::aligned( cmpnfo[cmp].bc * sizeof( short ) );
+		arena_size += 5 * arena::aligned( cmpnfo[cmp].bc * sizeof( char ) );
+	}
+	if ( !arena::reserve( arena_size ) ) {
+		sprintf( errormessage, MEM_ERRMSG.c_str() );
+		errorlevel = 2;
+		return false;
+	}
+	
 	// alloc memory for further operations
 	for ( cmp = 0; cmp < image::cmpc; cmp++ )
 	{
 		// alloc memory for colls
 		for ( bpos = 0; bpos < 64; bpos++ ) {
-			dct::colldata[cmp][bpos] = (short int*) calloc ( cmpnfo[cmp].bc, sizeof( short ) );
+			dct::colldata[cmp][bpos] = arena::take<short>( cmpnfo[cmp].bc );
 			if (dct::colldata[cmp][bpos] == nullptr) {
 				sprintf( errormessage, MEM_ERRMSG.c_str() );
 				errorlevel = 2;
@@ -3484,11 +4723,11 @@ bool jpg::setup_imginfo()
 		}
 		
 		// alloc memory for zdstlist / eob x / eob y
-		pjg::zdstdata[cmp] = (unsigned char*) calloc( cmpnfo[cmp].bc, sizeof( char ) );
-		pjg::eobxhigh[cmp] = (unsigned char*) calloc( cmpnfo[cmp].bc, sizeof( char ) );
-		pjg::eobyhigh[cmp] = (unsigned char*) calloc( cmpnfo[cmp].bc, sizeof( char ) );
-		pjg::zdstxlow[cmp] = (unsigned char*) calloc( cmpnfo[cmp].bc, sizeof( char ) );
-		pjg::zdstylow[cmp] = (unsigned char*) calloc( cmpnfo[cmp].bc, sizeof( char ) );
+		pjg::zdstdata[cmp] = arena::take<unsigned char>( cmpnfo[cmp].bc );
+		pjg::eobxhigh[cmp] = arena::take<unsigned char>( cmpnfo[cmp].bc );
+		pjg::eobyhigh[cmp] = arena::take<unsigned char>( cmpnfo[cmp].bc );
+		pjg::zdstxlow[cmp] = arena::take<unsigned char>( cmpnfo[cmp].bc );
+		pjg::zdstylow[cmp] = arena::take<unsigned char>( cmpnfo[cmp].bc );
 		if ( ( pjg::zdstdata[cmp] == nullptr) ||
 			( pjg::eobxhigh[cmp] == nullptr) || ( pjg::eobyhigh[cmp] == nullptr) ||
 			( pjg::zdstxlow[cmp] == nullptr) || ( pjg::zdstylow[cmp] == nullptr) ) {
@@ -3498,23 +4737,12 @@ bool jpg::setup_imginfo()
 		}
 	}
 	
-	// also decide automatic settings here
-	if ( auto_set ) {
-		for ( cmp = 0; cmp < image::cmpc; cmp++ ) {
-			for ( i = 0;
-				conf_sets[ i ][ cmpnfo[cmp].sid ] > (unsigned int) cmpnfo[ cmp ].bc;
-				i++ );
-			segm_cnt[ cmp ] = conf_segm;
-			nois_trs[ cmp ] = conf_ntrs[ i ][ cmpnfo[cmp].sid ];
-		}
-	}
-	
 	
 	return true;
 }
 
 // Builds Huffman trees and codes.
-bool jpg::jfif::parse_dht(unsigned int len, const unsigned char* segment) {
+bool jpg::jfif::parse_dht(unsigned int len, const unsigned char* segment, std::vector<HuffTable>& tables) {
 	int hpos = 4; // current position in segment, start after segment header
 	// build huffman trees & codes
 	while (hpos < len) {
@@ -3522,79 +4750,242 @@ bool jpg::jfif::parse_dht(unsigned int len, const unsigned char* segment) {
 		int rval = RBITS(segment[hpos], 4);
 		if (lval < 0 || lval >= 2 || rval < 0 || rval >= 4) {
 			break;
-		}
-
-		hpos++;
-		// build huffman codes & trees
-		jpg::hcodes[lval][rval] = jpg::jfif::build_huffcodes(&(segment[hpos + 0]), &(segment[hpos + 16]));
-		jpg::htrees[lval][rval] = jpg::jfif::build_hufftree(jpg::hcodes[lval][rval]);
-		jpg::htset[lval][rval] = true;
-
-		int skip = 16;
-		for (int i = 0; i < 16; i++) {
-			skip += (int)segment[hpos + i];
-		}
-		hpos += skip;
+		}
+
+		hpos++;
+		int skip = 16;
+		for (int i = 0; i < 16; i++) {
+			skip += (int)segment[hpos + i];
+		}
+
+		// build huffman codes & trees, standard tables are built once and shared
+		static std::array<std::unique_ptr<HuffTable>, 4> std_tables;
+		HuffTable table;
+		int std_id = -1;
+		for (int i = 0; i < 4; i++) {
+			if ((skip == std_huff_lengths[i]) && (hpos + skip <= int(len)) &&
+				std::equal(segment + hpos, segment + hpos + skip, std_huff_tables[i])) {
+				std_id = i;
+				break;
+			}
+		}
+		if (std_id < 0) {
+			table.codes = jpg::jfif::build_huffcodes(&(segment[hpos + 0]), &(segment[hpos + 16]));
+			table.tree = jpg::jfif::build_hufftree(table.codes);
+		} else {
+			if (!std_tables[std_id]) {
+				std_tables[std_id] = std::make_unique<HuffTable>();
+				std_tables[std_id]->codes = jpg::jfif::build_huffcodes(&(segment[hpos + 0]), &(segment[hpos + 16]));
+				std_tables[std_id]->tree = jpg::jfif::build_hufftree(std_tables[std_id]->codes);
+			}
+			table = *std_tables[std_id];
+		}
+		table.lval = lval;
+		table.rval = rval;
+		tables.push_back(table);
+
+		hpos += skip;
+	}
+
+	if (hpos != len) {
+		// if we get here, something went wrong
+		sprintf(errormessage, "size mismatch in dht marker");
+		errorlevel = 2;
+		return false;
+	}
+	return true;
+}
+
+void jpg::jfif::use_dht(const std::vector<HuffTable>& tables) {
+	for (const auto& table : tables) {
+		jpg::hcodes[table.lval][table.rval] = table.codes;
+		jpg::htrees[table.lval][table.rval] = table.tree;
+		jpg::htset[table.lval][table.rval] = true;
+	}
+}
+
+bool jpg::jfif::use_segment(const HeaderSegment& hseg) {
+	switch (hseg.type) {
+		case 0xC4: // DHT segment
+			jpg::jfif::use_dht(hseg.dht);
+			return true;
+
+		case 0xDD: // DRI segment
+			jpg::jfif::parse_dri(&(hdrdata[hseg.pos]));
+			return true;
+
+		case 0xDA: // SOS segment
+			return jpg::jfif::parse_sos(&(hdrdata[hseg.pos]));
+
+		default:
+			return true;
+	}
+}
+
+// Copy quantization tables to internal memory
+bool jpg::jfif::parse_dqt(unsigned len, const unsigned char* segment) {
+	int hpos = 4; // current position in segment, start after segment header
+	while (hpos < len) {
+		int lval = LBITS( segment[ hpos ], 4 );
+		int rval = RBITS( segment[ hpos ], 4 );
+		if (lval < 0 || lval >= 2) {
+			break;
+		}
+		if (rval < 0 || rval >= 4) {
+			break;
+		}
+		hpos++;
+		if (lval == 0) { // 8 bit precision
+			for (int i = 0; i < 64; i++) {
+				qtables[rval][i] = (unsigned short) segment[hpos + i];
+				if (qtables[rval][i] == 0) {
+					break;
+				}
+			}
+			hpos += 64;
+		} else { // 16 bit precision
+			for (int i = 0; i < 64; i++) {
+				qtables[rval][i] =
+					pack( segment[ hpos + (2*i) ], segment[ hpos + (2*i) + 1 ] );
+				if (qtables[rval][i] == 0) {
+					break;
+				}
+			}
+			hpos += 128;
+		}
+	}
+
+	if (hpos != len) {
+		// if we get here, something went wrong
+		sprintf(errormessage, "size mismatch in dqt marker");
+		errorlevel = 2;
+		return false;
+	}
+	return true;
+}
+
+// define restart interval
+void jpg::jfif::parse_dri(const unsigned char* segment) {
+	int hpos = 4; // current position in segment, start after segment header
+	jpg::rsti = pack( segment[ hpos ], segment[ hpos + 1 ] );
+}
+
+bool jpg::jfif::check_sof(unsigned char type, unsigned int len, const unsigned char* segment) {
+	int hpos = 4; // current position in segment, start after segment header
+
+	switch ( type )
+	{
+		case 0xC0: // SOF0 segment
+			// coding process: baseline DCT
+		case 0xC1: // SOF1 segment
+			// coding process: extended sequential DCT
+		case 0xC2: // SOF2 segment
+			// coding process: progressive DCT
+			break;
+		
+		case 0xC3: // SOF3 segment
+			// coding process: lossless sequential
+			sprintf( errormessage, "sof3 marker found, image is coded lossless" );
+			errorlevel = 2;
+			return false;
+		
+		case 0xC5: // SOF5 segment
+			// coding process: differential sequential DCT
+			sprintf( errormessage, "sof5 marker found, image is coded diff. sequential" );
+			errorlevel = 2;
+			return false;
+		
+		case 0xC6: // SOF6 segment
+			// coding process: differential progressive DCT
+			sprintf( errormessage, "sof6 marker found, image is coded diff. progressive" );
+			errorlevel = 2;
+			return false;
+		
+		case 0xC7: // SOF7 segment
+			// coding process: differential lossless
+			sprintf( errormessage, "sof7 marker found, image is coded diff. lossless" );
+			errorlevel = 2;
+			return false;
+			
+		case 0xC9: // SOF9 segment
+			// coding process: arithmetic extended sequential DCT
+			sprintf( errormessage, "sof9 marker found, image is coded arithm. sequential" );
+			errorlevel = 2;
+			return false;
+			
+		case 0xCA: // SOF10 segment
+			// coding process: arithmetic extended sequential DCT
+			sprintf( errormessage, "sof10 marker found, image is coded arithm. progressive" );
+			errorlevel = 2;
+			return false;
+			
+		case 0xCB: // SOF11 segment
+			// coding process: arithmetic extended sequential DCT
+			sprintf( errormessage, "sof11 marker found, image is coded arithm. lossless" );
+			errorlevel = 2;
+			return false;
+			
+		case 0xCD: // SOF13 segment
+			// coding process: arithmetic differntial sequential DCT
+			sprintf( errormessage, "sof13 marker found, image is coded arithm. diff. sequential" );
+			errorlevel = 2;
+			return false;
+			
+		case 0xCE: // SOF14 segment
+			// coding process: arithmetic differential progressive DCT
+			sprintf( errormessage, "sof14 marker found, image is coded arithm. diff. progressive" );
+			errorlevel = 2;
+			return false;
+		
+		case 0xCF: // SOF15 segment
+			// coding process: arithmetic differntial lossless
+			sprintf( errormessage, "sof15 marker found, image is coded arithm. diff. lossless" );
+			errorlevel = 2;
+			return false;
+		
+		default:
+			break;
 	}
 
-	if (hpos != len) {
-		// if we get here, something went wrong
-		sprintf(errormessage, "size mismatch in dht marker");
+	// segment has to hold precision, size & component count
+	if (len < 10) {
+		sprintf(errormessage, "header contains incomplete information");
 		errorlevel = 2;
 		return false;
 	}
-	return true;
-}
 
-// Copy quantization tables to internal memory
-bool jpg::jfif::parse_dqt(unsigned len, const unsigned char* segment) {
-	int hpos = 4; // current position in segment, start after segment header
-	while (hpos < len) {
-		int lval = LBITS( segment[ hpos ], 4 );
-		int rval = RBITS( segment[ hpos ], 4 );
-		if (lval < 0 || lval >= 2) {
-			break;
-		}
-		if (rval < 0 || rval >= 4) {
-			break;
-		}
-		hpos++;
-		if (lval == 0) { // 8 bit precision
-			for (int i = 0; i < 64; i++) {
-				qtables[rval][i] = (unsigned short) segment[hpos + i];
-				if (qtables[rval][i] == 0) {
-					break;
-				}
-			}
-			hpos += 64;
-		} else { // 16 bit precision
-			for (int i = 0; i < 64; i++) {
-				qtables[rval][i] =
-					pack( segment[ hpos + (2*i) ], segment[ hpos + (2*i) + 1 ] );
-				if (qtables[rval][i] == 0) {
-					break;
-				}
-			}
-			hpos += 128;
-		}
+	// check data precision, only 8 bit is allowed
+	int lval = segment[hpos];
+	if (lval != 8) {
+		sprintf(errormessage, "%i bit data precision is not supported", lval);
+		errorlevel = 2;
+		return false;
 	}
 
-	if (hpos != len) {
-		// if we get here, something went wrong
-		sprintf(errormessage, "size mismatch in dqt marker");
+	// image size, height & component count
+	const int height = pack(segment[hpos + 1], segment[hpos + 2]);
+	const int width = pack(segment[hpos + 3], segment[hpos + 4]);
+	const int cmpc = segment[hpos + 5];
+	if ((width == 0) || (height == 0)) {
+		sprintf(errormessage, "resolution is %ix%i, possible malformed JPEG", width, height);
+		errorlevel = 2;
+		return false;
+	}
+	if (cmpc > 4) {
+		sprintf(errormessage, "image has %i components, max 4 are supported", cmpc);
+		errorlevel = 2;
+		return false;
+	}
+	if (len < 10u + 3u * cmpc) {
+		sprintf(errormessage, "header contains incomplete information");
 		errorlevel = 2;
 		return false;
 	}
-	return true;
-}
 
-// define restart interval
-void jpg::jfif::parse_dri(const unsigned char* segment) {
-	int hpos = 4; // current position in segment, start after segment header
-	jpg::rsti = pack( segment[ hpos ], segment[ hpos + 1 ] );
+	return true;
 }
 
-bool jpg::jfif::parse_sof(unsigned char type, const unsigned char* segment) {
+void jpg::jfif::parse_sof(unsigned char type, const unsigned char* segment) {
 	int hpos = 4; // current position in segment, start after segment header
 
 	// set JPEG coding type
@@ -3604,28 +4995,10 @@ bool jpg::jfif::parse_sof(unsigned char type, const unsigned char* segment) {
 		jpegtype = JpegType::SEQUENTIAL;
 	}
 
-	// check data precision, only 8 bit is allowed
-	int lval = segment[hpos];
-	if (lval != 8) {
-		sprintf(errormessage, "%i bit data precision is not supported", lval);
-		errorlevel = 2;
-		return false;
-	}
-
 	// image size, height & component count
 	image::imgheight = pack(segment[hpos + 1], segment[hpos + 2]);
 	image::imgwidth = pack(segment[hpos + 3], segment[hpos + 4]);
 	image::cmpc = segment[hpos + 5];
-	if ((image::imgwidth == 0) || (image::imgheight == 0)) {
-		sprintf(errormessage, "resolution is %ix%i, possible malformed JPEG", image::imgwidth, image::imgheight);
-		errorlevel = 2;
-		return false;
-	}
-	if (image::cmpc > 4) {
-		sprintf(errormessage, "image has %i components, max 4 are supported", image::cmpc);
-		errorlevel = 2;
-		return false;
-	}
 
 	hpos += 6;
 	// components contained in image
@@ -3636,8 +5009,6 @@ bool jpg::jfif::parse_sof(unsigned char type, const unsigned char* segment) {
 		cmpnfo[cmp].qtable = qtables[segment[hpos + 2]];
 		hpos += 3;
 	}
-
-	return true;
 }
 
 bool jpg::jfif::parse_sos(const unsigned char* segment) {
@@ -3693,7 +5064,12 @@ bool jpg::jfif::parse_jfif(unsigned char type, unsigned int len, const unsigned
 	switch ( type )
 	{
 		case 0xC4: // DHT segment
-			return jpg::jfif::parse_dht(len, segment);
+		{
+			std::vector<HuffTable> tables;
+			if ( !jpg::jfif::parse_dht(len, segment, tables) ) return false;
+			jpg::jfif::use_dht(tables);
+			return true;
+		}
 		
 		case 0xDB: // DQT segment
 			return jpg::jfif::parse_dqt(len, segment);
@@ -3707,75 +5083,23 @@ bool jpg::jfif::parse_jfif(unsigned char type, unsigned int len, const unsigned
 			return jpg::jfif::parse_sos(segment);
 		
 		case 0xC0: // SOF0 segment
-			// coding process: baseline DCT
-			
 		case 0xC1: // SOF1 segment
-			// coding process: extended sequential DCT
-		
 		case 0xC2: // SOF2 segment
-			// coding process: progressive DCT
-
-			return jpg::jfif::parse_sof(type, segment);
-		
 		case 0xC3: // SOF3 segment
-			// coding process: lossless sequential
-			sprintf( errormessage, "sof3 marker found, image is coded lossless" );
-			errorlevel = 2;
-			return false;
-		
 		case 0xC5: // SOF5 segment
-			// coding process: differential sequential DCT
-			sprintf( errormessage, "sof5 marker found, image is coded diff. sequential" );
-			errorlevel = 2;
-			return false;
-		
 		case 0xC6: // SOF6 segment
-			// coding process: differential progressive DCT
-			sprintf( errormessage, "sof6 marker found, image is coded diff. progressive" );
-			errorlevel = 2;
-			return false;
-		
 		case 0xC7: // SOF7 segment
-			// coding process: differential lossless
-			sprintf( errormessage, "sof7 marker found, image is coded diff. lossless" );
-			errorlevel = 2;
-			return false;
-			
 		case 0xC9: // SOF9 segment
-			// coding process: arithmetic extended sequential DCT
-			sprintf( errormessage, "sof9 marker found, image is coded arithm. sequential" );
-			errorlevel = 2;
-			return false;
-			
 		case 0xCA: // SOF10 segment
-			// coding process: arithmetic extended sequential DCT
-			sprintf( errormessage, "sof10 marker found, image is coded arithm. progressive" );
-			errorlevel = 2;
-			return false;
-			
 		case 0xCB: // SOF11 segment
-			// coding process: arithmetic extended sequential DCT
-			sprintf( errormessage, "sof11 marker found, image is coded arithm. lossless" );
-			errorlevel = 2;
-			return false;
-			
 		case 0xCD: // SOF13 segment
-			// coding process: arithmetic differntial sequential DCT
-			sprintf( errormessage, "sof13 marker found, image is coded arithm. diff. sequential" );
-			errorlevel = 2;
-			return false;
-			
 		case 0xCE: // SOF14 segment
-			// coding process: arithmetic differential progressive DCT
-			sprintf( errormessage, "sof14 marker found, image is coded arithm. diff. progressive" );
-			errorlevel = 2;
-			return false;
-		
 		case 0xCF: // SOF15 segment
-			// coding process: arithmetic differntial lossless
-			sprintf( errormessage, "sof15 marker found, image is coded arithm. diff. lossless" );
-			errorlevel = 2;
-			return false;
+			// unsupported coding processes are rejected here
+			if ( !jpg::jfif::check_sof( type, len, segment ) )
+				return false;
+			jpg::jfif::parse_sof( type, segment );
+			return true;
 			
 		case 0xE0: // APP0 segment	
 		case 0xE1: // APP1 segment
@@ -3832,25 +5156,18 @@ bool jpg::jfif::parse_jfif(unsigned char type, unsigned int len, const unsigned
 
 bool jpg::rebuild_header()
 {		
-	unsigned char  type; // type of current marker segment
-	unsigned int   len; // length of current marker segment
-	unsigned int   hpos = 0; // position in header	
-	
-	
 	// start headerwriter
 	auto hdrw = std::make_unique<abytewriter>( 4096 ); // new header writer
 	
 	// header parser loop
-	while ( ( int ) hpos < hdrs ) {
-		type = hdrdata[ hpos + 1 ];
-		len = 2 + pack( hdrdata[ hpos + 2 ], hdrdata[ hpos + 3 ] );
+	for ( const auto& hseg : jpg::hdrsegs ) {
+		const unsigned char type = hseg.type; // type of current marker segment
 		// discard any unneeded meta info
 		if ( ( type == 0xDA ) || ( type == 0xC4 ) || ( type == 0xDB ) ||
 			 ( type == 0xC0 ) || ( type == 0xC1 ) || ( type == 0xC2 ) ||
 			 ( type == 0xDD ) ) {
-			hdrw->write_n( &(hdrdata[ hpos ]), len );
+			hdrw->write_n( &(hdrdata[ hseg.pos ]), hseg.len );
 		}
-		hpos += len;
 	}
 	
 	// replace current header with the new one
@@ -3858,6 +5175,33 @@ bool jpg::rebuild_header()
 	hdrdata = hdrw->getptr();
 	hdrs    = hdrw->getpos();	
 	
+	// positions have changed, index again
+	return jpg::index_header();
+}
+
+bool jpg::index_header()
+{
+	std::size_t hpos = 0; // position in header
+	
+	
+	jpg::hdrsegs.clear();
+	
+	// header parser loop, check every segment against the header size
+	while ( hpos < hdrs ) {
+		if ( hpos + 4 > hdrs ) break;
+		const int len = 2 + pack( hdrdata[ hpos + 2 ], hdrdata[ hpos + 3 ] ); // length of current marker segment
+		if ( hpos + std::size_t( len ) > hdrs ) break;
+		jpg::hdrsegs.push_back( HeaderSegment{ hdrdata[ hpos + 1 ], hpos, len, {} } );
+		hpos += len;
+	}
+	
+	if ( hpos != hdrs ) {
+		sprintf( errormessage, "size mismatch in header segments" );
+		errorlevel = 2;
+		return false;
+	}
+	
+	
 	return true;
 }
 
@@ -3910,6 +5254,53 @@ int jpg::decode::block_seq(const std::unique_ptr<abitreader>& huffr, const HuffT
 	return eob;
 }
 
+jpg::CodingStatus jpg::decode::seq_tile(const std::unique_ptr<abitreader>& huffr, jpg::BlockTile& tile, std::array<int, 4>& lastdc,
+                                        int* mcu, int* cmp, int* csc, int* sub, int* dpos, int* rstw)
+{
+	jpg::CodingStatus status = jpg::CodingStatus::OKAY;
+	
+	// decode a tile of blocks
+	for ( tile.count = 0; ( status == jpg::CodingStatus::OKAY ) &&
+		( tile.count < jpg::BlockTile::capacity ); ) {
+		auto& tblock = tile.block[ tile.count ];
+		int eob = jpg::decode::block_seq( huffr,
+		                                  jpg::htrees[ 0 ][ cmpnfo[(*cmp)].huffdc ],
+		                                  jpg::htrees[ 1 ][ cmpnfo[(*cmp)].huffdc ],
+		                                  tblock.data() );
+		
+		// check for errors, proceed if no error encountered
+		if ( eob < 0 ) {
+			status = jpg::CodingStatus::ERROR;
+			break;
+		}
+		
+		// check for non optimal coding
+		if ( ( eob > 1 ) && ( tblock[ eob - 1 ] == 0 ) ) {
+			sprintf( errormessage, "reconstruction of inefficient coding not supported" );
+			errorlevel = 1;
+		}
+		
+		// fix dc
+		tblock[ 0 ] += lastdc[ (*cmp) ];
+		lastdc[ (*cmp) ] = tblock[ 0 ];
+		
+		// store eob & position, bands past eob are never copied
+		tile.eob[ tile.count ] = eob;
+		tile.cmp[ tile.count ] = (*cmp);
+		tile.dpos[ tile.count++ ] = (*dpos);
+		
+		if ( curr_scan::cmpc > 1 )
+			status = jpg::next_mcupos( mcu, cmp, csc, sub, dpos, rstw );
+		else
+			status = jpg::next_mcuposn( (*cmp), dpos, rstw );
+	}
+	
+	// copy to dct::colldata
+	jpg::tile_scatter( tile, 0 );
+	
+	return status;
+}
+
 int jpg::encode::block_seq(const std::unique_ptr<abitwriter>& huffw, const HuffCodes& dctbl, const HuffCodes& actbl, const std::array<std::int16_t, 64>& block)
 {
 	// encode DC
@@ -3925,6 +5316,13 @@ int jpg::encode::block_seq(const std::unique_ptr<abitwriter>& huffw, const HuffC
 				huffw->write(actbl.cval[0xF0], actbl.clen[0xF0]);
 				z -= 16;
 			}
+			// small values: code and vli from emit table
+			if (actbl.emit && (unsigned(block[bpos] + 15) <= 30)) {
+				const std::uint32_t e = (*actbl.emit)[(z << 5) + block[bpos] + 16];
+				huffw->write(e >> 5, e & 0x1F);
+				z = 0;
+				continue;
+			}
 			// vli encode
 			int s = bitlen2048n( block[ bpos ] );
 			std::uint16_t n = envli( s, block[ bpos ] );
@@ -3961,6 +5359,47 @@ jpg::CodingStatus jpg::decode::dc_prg_fs(const std::unique_ptr<abitreader>& huff
 	return jpg::CodingStatus::OKAY;
 }
 
+jpg::CodingStatus jpg::encode::seq_tile(const std::unique_ptr<abitwriter>& huffw, jpg::BlockTile& tile, std::array<int, 4>& lastdc,
+                                        int* mcu, int* cmp, int* csc, int* sub, int* dpos, int* rstw)
+{
+	jpg::CodingStatus status = jpg::CodingStatus::OKAY;
+	
+	// collect positions for the next tile of blocks
+	for ( tile.count = 0; ( status == jpg::CodingStatus::OKAY ) &&
+		( tile.count < jpg::BlockTile::capacity ); ) {
+		tile.cmp[ tile.count ] = (*cmp);
+		tile.dpos[ tile.count++ ] = (*dpos);
+		if ( curr_scan::cmpc > 1 )
+			status = jpg::next_mcupos( mcu, cmp, csc, sub, dpos, rstw );
+		else
+			status = jpg::next_mcuposn( (*cmp), dpos, rstw );
+	}
+	
+	// copy from colldata
+	jpg::tile_gather( tile, 0, 63 );
+	
+	for ( int i = 0; i < tile.count; i++ ) {
+		auto& tblock = tile.block[ i ];
+		const int tcmp = tile.cmp[ i ];
+		
+		// diff coding for dc
+		const int dc = tblock[ 0 ];
+		tblock[ 0 ] -= lastdc[ tcmp ];
+		lastdc[ tcmp ] = dc;
+		
+		// encode block
+		int eob = jpg::encode::block_seq( huffw,
+		                                  jpg::hcodes[0][cmpnfo[tcmp].huffdc],
+		                                  jpg::hcodes[1][cmpnfo[tcmp].huffac],
+		                                  tblock );
+		
+		// check for errors
+		if ( eob < 0 ) status = jpg::CodingStatus::ERROR;
+	}
+	
+	return status;
+}
+
 void jpg::encode::dc_prg_fs(const std::unique_ptr<abitwriter>& huffw, const HuffCodes& dctbl, const std::array<std::int16_t, 64>& block)
 {
 	// encode DC	
@@ -4040,6 +5479,13 @@ int jpg::encode::ac_prg_fs(const std::unique_ptr<abitwriter>& huffw, const HuffC
 				huffw->write( actbl.cval[ 0xF0 ], actbl.clen[ 0xF0 ] );
 				z -= 16;
 			}			
+			// small values: code and vli from emit table
+			if ( actbl.emit && ( unsigned( block[ bpos ] + 15 ) <= 30 ) ) {
+				const std::uint32_t e = ( *actbl.emit )[ ( z << 5 ) + block[ bpos ] + 16 ];
+				huffw->write( e >> 5, e & 0x1F );
+				z = 0;
+				continue;
+			}
 			// vli encode
 			s = bitlen2048n( block[ bpos ] );
 			n = envli( s, block[ bpos ] );
@@ -4229,17 +5675,50 @@ int jpg::encode::ac_prg_sa(const std::unique_ptr<abitwriter>& huffw, const std::
 	return eob;
 }
 
-void jpg::decode::eobrun_sa(const std::unique_ptr<abitreader>& huffr, short* block, int* eobrun, int from, int to)
+void jpg::decode::eobrun_sa(const std::unique_ptr<abitreader>& huffr, const BlockTile& tile, int cmp, int from, int to)
 {
-	unsigned short n;
-	int bpos;
-	
-	
-	// fast eobrun decoding routine for succesive approximation
-	for ( bpos = from; bpos <= to; bpos++ ) {
-		if ( block[ bpos ] != 0 ) {
-			n = huffr->read_bit();
-			block[ bpos ] = ( block[ bpos ] > 0 ) ? n : -n;
+	std::array<std::uint64_t, BlockTile::capacity> nzmask; // nonzero coefficients of each block
+	std::array<std::uint64_t, BlockTile::capacity> crmask; // set correction bits of each block
+	
+	
+	// find nonzero coefficients, band by band
+	std::fill( nzmask.begin(), nzmask.begin() + tile.count, 0 );
+	for ( int bpos = from; bpos <= to; bpos++ ) {
+		const short* band = dct::colldata[ cmp ][ bpos ];
+		for ( int i = 0; i < tile.count; i++ )
+			nzmask[ i ] |= std::uint64_t( band[ tile.dpos[ i ] ] != 0 ) << bpos;
+	}
+	
+	// read correction bits, one or two reads per block
+	for ( int i = 0; i < tile.count; i++ ) {
+		int nbits = 0;
+		for ( std::uint64_t m = nzmask[ i ]; m != 0; m &= m - 1 )
+			nbits++;
+		std::uint64_t bits = 0;
+		if ( nbits > 32 ) {
+			bits = std::uint64_t( huffr->read( nbits - 32 ) ) << 32;
+			bits |= huffr->read( 32 );
+		}
+		else if ( nbits > 0 ) {
+			bits = huffr->read( nbits );
+		}
+		// first bit read belongs to the lowest band
+		crmask[ i ] = 0;
+		for ( std::uint64_t m = nzmask[ i ]; m != 0; m &= m - 1 ) {
+			if ( ( bits >> --nbits ) & 1 )
+				crmask[ i ] |= m & ( ~m + 1 );
+		}
+	}
+	
+	// apply correction bits, band by band
+	const int corr = 1 << curr_scan::sal;
+	for ( int bpos = from; bpos <= to; bpos++ ) {
+		short* band = dct::colldata[ cmp ][ bpos ];
+		for ( int i = 0; i < tile.count; i++ ) {
+			if ( ( crmask[ i ] >> bpos ) & 1 ) {
+				short& coef = band[ tile.dpos[ i ] ];
+				coef += ( coef > 0 ) ? corr : -corr;
+			}
 		}
 	}
 }
@@ -4301,6 +5780,35 @@ int jpg::decode::next_huffcode(const std::unique_ptr<abitreader>& huffr, const H
 	return ( node - 256 );
 }
 
+void jpg::tile_scatter(const BlockTile& tile, int from)
+{
+	// band-major sweep over the tile, writes to each band array are sequential;
+	// bands past eob are skipped, pages of the (zeroed) band arrays are only touched where coded
+	int top = from;
+	for ( int i = 0; i < tile.count; i++ )
+		top = std::max( top, tile.eob[ i ] );
+	for ( int bpos = from; bpos < top; bpos++ ) {
+		short* band[ 4 ];
+		for ( int cmp = 0; cmp < image::cmpc; cmp++ )
+			band[ cmp ] = dct::colldata[ cmp ][ bpos ];
+		for ( int i = 0; i < tile.count; i++ )
+			if ( bpos < tile.eob[ i ] )
+				band[ tile.cmp[ i ] ][ tile.dpos[ i ] ] = tile.block[ i ][ bpos ];
+	}
+}
+
+void jpg::tile_gather(BlockTile& tile, int from, int to)
+{
+	// band-major sweep over the tile, reads from each band array are sequential
+	for ( int bpos = from; bpos <= to; bpos++ ) {
+		const short* band[ 4 ];
+		for ( int cmp = 0; cmp < image::cmpc; cmp++ )
+			band[ cmp ] = dct::colldata[ cmp ][ bpos ];
+		for ( int i = 0; i < tile.count; i++ )
+			tile.block[ i ][ bpos ] = band[ tile.cmp[ i ] ][ tile.dpos[ i ] ];
+	}
+}
+
 jpg::CodingStatus jpg::next_mcupos(int* mcu, int* cmp, int* csc, int* sub, int* dpos, int* rstw)
 {
 	jpg::CodingStatus sta = jpg::CodingStatus::OKAY;
@@ -4433,6 +5941,23 @@ HuffCodes jpg::jfif::build_huffcodes(const unsigned char* clen, const unsigned c
 			break;
 		}
 	}
+	
+	// combine codes and vli values of small coefficients
+	auto emit = std::make_shared<AcEmitTable>();
+	emit->fill(0);
+	for (int z = 0; z < 16; z++) {
+		for (int v = -15; v <= 15; v++) {
+			if (v == 0) {
+				continue;
+			}
+			const int s = bitlen2048n(v);
+			const int hc = (z << 4) + s;
+			const std::uint32_t bits = (std::uint32_t(codes.cval[hc]) << s) | std::uint32_t(envli(s, v));
+			(*emit)[(z << 5) + v + 16] = (bits << 5) | std::uint32_t(codes.clen[hc] + s);
+		}
+	}
+	codes.emit = emit;
+	
 	return codes;
 }
 
@@ -4599,7 +6124,6 @@ void pjg::encode::zdst_low(const std::unique_ptr<aricoder>& enc, int cmp)
 	----------------------------------------------- */
 void pjg::encode::dc(const std::unique_ptr<aricoder>& enc, int cmp)
 {	
-	unsigned short* c_absc[ 6 ]; // quick access array for contexts
 	int c_weight[ 6 ]; // weighting for contexts
 
 	// decide segmentation setting
@@ -4618,11 +6142,11 @@ void pjg::encode::dc(const std::unique_ptr<aricoder>& enc, int cmp)
 	const int bc = cmpnfo[cmp].bc;
 	const int w = cmpnfo[cmp].bch;
 	
-	// allocate memory for absolute values storage
-	std::vector<unsigned short> absv_store(bc); // absolute coefficients values storage
+	// absolute values storage, last three rows
+	pjg::RowRing<unsigned short> absv_store(w);
 	
-	// set up context quick access array
-	pjg::aavrg_prepare( c_absc, c_weight, absv_store.data(), cmp );
+	// set up context weights
+	pjg::aavrg_prepare( c_weight );
 	
 	// locally store pointer to coefficients and zero distribution list
 	const short* coeffs = dct::colldata[ cmp ][ 0 ]; // Pointer to current coefficent data.
@@ -4636,11 +6160,12 @@ void pjg::encode::dc(const std::unique_ptr<aricoder>& enc, int cmp)
 		// r_y = h - ( p_y + 1 );
 		const int p_x = dpos % w;
 		const int r_x = w - ( p_x + 1 );
+		absv_store.advance( p_y );
 		
 		// get segment-number from zero distribution list and segmentation set
 		const int snum = segm_tab[ zdstls[dpos] ];
 		// calculate contexts (for bit length)
-		const int ctx_avr = pjg::aavrg_context( c_absc, c_weight, dpos, p_y, p_x, r_x ); // Average context
+		const int ctx_avr = pjg::aavrg_context( absv_store, c_weight, p_y, p_x, r_x ); // Average context
 		const int ctx_len = bitlen1024p( ctx_avr ); // Bitlength context.
 		// shift context / do context modelling (segmentation is done per context)
 		shift_model( mod_len, ctx_len, snum );
@@ -4668,7 +6193,7 @@ void pjg::encode::dc(const std::unique_ptr<aricoder>& enc, int cmp)
 			// encode sign
 			enc->encode_ari( mod_sgn, sgn );
 			// store absolute value
-			absv_store[ dpos ] = absv;
+			absv_store.row( p_y )[ p_x ] = absv;
 		}
 	}
 	
@@ -4684,7 +6209,6 @@ void pjg::encode::dc(const std::unique_ptr<aricoder>& enc, int cmp)
 	----------------------------------------------- */
 void pjg::encode::ac_high(const std::unique_ptr<aricoder>& enc, int cmp)
 {	
-	unsigned short* c_absc[ 6 ]; // quick access array for contexts
 	int c_weight[ 6 ]; // weighting for contexts
 	
 	// decide segmentation setting
@@ -4699,15 +6223,11 @@ void pjg::encode::ac_high(const std::unique_ptr<aricoder>& enc, int cmp)
 	const int bc = cmpnfo[cmp].bc;
 	const int w = cmpnfo[cmp].bch;
 	
-	// allocate memory for absolute values & signs storage
-	std::vector<std::uint16_t> absv_store(bc);	// absolute coefficients values storage
-	std::vector<std::uint8_t> sgn_store(bc); // sign storage for context	
+	// absolute values & signs storage, last three rows
+	pjg::RowRing<unsigned short> absv_store(w);
+	pjg::RowRing<unsigned char> sgn_store(w);
 	std::vector<std::uint8_t> zdstls(pjg::zdstdata[cmp], pjg::zdstdata[cmp] + bc); // copy of zero distribution list
 	
-	// set up quick access arrays for signs context
-	unsigned char* sgn_nbh = sgn_store.data() - 1; // Left signs neighbor.
-	unsigned char* sgn_nbv = sgn_store.data() - w; // Upper signs neighbor.
-	
 	// locally store pointer to eob x / eob y
 	unsigned char* eob_x = pjg::eobxhigh[ cmp ]; // Pointer to x eobs.
 	unsigned char* eob_y = pjg::eobyhigh[ cmp ]; // Pointer to y eobs.
@@ -4716,6 +6236,14 @@ void pjg::encode::ac_high(const std::unique_ptr<aricoder>& enc, int cmp)
 	std::fill(eob_x, eob_x + bc, static_cast<unsigned char>(0));
 	std::fill(eob_y, eob_y + bc, static_cast<unsigned char>(0));
 	
+	// sparse list of blocks with nonzeros left in the 7x7 bands, taken from the zero distribution list,
+	// blocks drop out once all their nonzeros are coded
+	std::vector<int> active;
+	active.reserve(bc);
+	for (int dpos = 0; dpos < bc; dpos++) {
+		if (zdstls[dpos] > 0) active.push_back(dpos);
+	}
+	
 	// work through lower 7x7 bands in order of pjg::freqscan
 	for (int i = 1; i < 64; i++ )
 	{		
@@ -4727,12 +6255,10 @@ void pjg::encode::ac_high(const std::unique_ptr<aricoder>& enc, int cmp)
 		if ( ( b_x == 0 ) || ( b_y == 0 ) )
 			continue; // process remaining coefficients elsewhere
 	
-		// preset absolute values/sign storage
-		std::fill(std::begin(absv_store), std::end(absv_store), static_cast<std::uint16_t>(0));
-		std::fill(std::begin(sgn_store), std::end(sgn_store), static_cast<std::uint8_t>(0));
-		
-		// set up average context quick access arrays
-		pjg::aavrg_prepare( c_absc, c_weight, absv_store.data(), cmp );
+		// set up average context weights, forget values of the previous band
+		pjg::aavrg_prepare( c_weight );
+		absv_store.reset();
+		sgn_store.reset();
 		
 		// locally store pointer to coefficients
 		const short* coeffs = dct::colldata[ cmp ][ bpos ]; // Pointer to current coefficent data.
@@ -4741,22 +6267,20 @@ void pjg::encode::ac_high(const std::unique_ptr<aricoder>& enc, int cmp)
 		const int max_val = MAX_V( cmp, bpos ); // Max value.
 		const int max_len = bitlen1024p( max_val ); // Max bitlength.
 		
-		// arithmetic compression loo
-		for (int dpos = 0; dpos < bc; dpos++ )
-		{		
-			// skip if beyound eob
-			if ( zdstls[dpos] == 0 )
-				continue;
-		
+		// arithmetic compression loop, blocks beyond eob are not in the list
+		for (const int dpos : active)
+		{
 			//calculate x/y positions in band
 			const int p_y = dpos / w;
 			const int p_x = dpos % w;
 			const int r_x = w - ( p_x + 1 );
+			absv_store.advance( p_y );
+			sgn_store.advance( p_y );
 		
 			// get segment-number from zero distribution list and segmentation set
 			const int snum = segm_tab[ zdstls[dpos] ];
 			// calculate contexts (for bit length)
-			const int ctx_avr = pjg::aavrg_context( c_absc, c_weight, dpos, p_y, p_x, r_x ); // Average context.
+			const int ctx_avr = pjg::aavrg_context( absv_store, c_weight, p_y, p_x, r_x ); // Average context.
 			const int ctx_len = bitlen1024p( ctx_avr ); // Bitlength context.
 			// shift context / do context modelling (segmentation is done per context)
 			shift_model( mod_len, ctx_len, snum );
@@ -4783,19 +6307,26 @@ void pjg::encode::ac_high(const std::unique_ptr<aricoder>& enc, int cmp)
 					enc->encode_ari( mod_res, bt );
 				}
 				// encode sign				
-				int ctx_sgn = ( p_x > 0 ) ? sgn_nbh[ dpos ] : 0; // Sign context.
-				if ( p_y > 0 ) ctx_sgn += 3 * sgn_nbv[ dpos ]; // IMPROVE !!!!!!!!!!!
+				int ctx_sgn = ( p_x > 0 ) ? sgn_store.row( p_y )[ p_x - 1 ] : 0; // Sign context.
+				if ( p_y > 0 ) ctx_sgn += 3 * sgn_store.row( p_y - 1 )[ p_x ]; // IMPROVE !!!!!!!!!!!
 				mod_sgn->shift_context( ctx_sgn );
 				enc->encode_ari( mod_sgn, sgn );
 				// store absolute value/sign, decrement zdst
-				absv_store[ dpos ] = absv;
-				sgn_store[ dpos ] = sgn + 1;
+				absv_store.row( p_y )[ p_x ] = absv;
+				sgn_store.row( p_y )[ p_x ] = sgn + 1;
 				zdstls[dpos]--;
 				// recalculate x/y eob				
 				if ( b_x > eob_x[dpos] ) eob_x[dpos] = b_x;
 				if ( b_y > eob_y[dpos] ) eob_y[dpos] = b_y;
 			}
 		}
+		// remove finished blocks from the list
+		std::size_t remaining = 0;
+		for (const int dpos : active) {
+			if (zdstls[dpos] > 0) active[remaining++] = dpos;
+		}
+		active.resize(remaining);
+		
 		// flush models
 		mod_len->flush_model();
 		mod_res->flush_model();
@@ -4950,11 +6481,11 @@ void pjg::encode::ac_low(const std::unique_ptr<aricoder>& enc, int cmp)
 /* -----------------------------------------------
 	encodes a stream of generic (8bit) data to pjg
 	----------------------------------------------- */
-bool pjg::encode::generic( const std::unique_ptr<aricoder>& enc, unsigned char* data, int len )
+bool pjg::encode::generic( const std::unique_ptr<aricoder>& enc, unsigned char* data, std::size_t len )
 {
 	// arithmetic encode data
 	auto model = INIT_MODEL_S(256 + 1, 256, 1);
-	for (int i = 0; i < len; i++ ) {
+	for (std::size_t i = 0; i < len; i++ ) {
 		enc->encode_ari( model, data[ i ] );
 		model->shift_context( data[ i ] );
 	}
@@ -5102,7 +6633,6 @@ void pjg::decode::zdst_low(const std::unique_ptr<aricoder>& dec, int cmp)
 	----------------------------------------------- */
 void pjg::decode::dc(const std::unique_ptr<aricoder>& dec, int cmp)
 {	
-	unsigned short* c_absc[ 6 ]; // quick access array for contexts
 	int c_weight[ 6 ]; // weighting for contexts
 	
 	// decide segmentation setting
@@ -5121,11 +6651,11 @@ void pjg::decode::dc(const std::unique_ptr<aricoder>& dec, int cmp)
 	const int bc = cmpnfo[cmp].bc;
 	const int w = cmpnfo[cmp].bch;
 	
-	// allocate memory for absolute values storage
-	std::vector<unsigned short> absv_store(bc); // absolute coefficients values storage
+	// absolute values storage, last three rows
+	pjg::RowRing<unsigned short> absv_store(w);
 	
-	// set up context quick access array
-	pjg::aavrg_prepare( c_absc, c_weight, absv_store.data(), cmp );
+	// set up context weights
+	pjg::aavrg_prepare( c_weight );
 	
 	// locally store pointer to coefficients and zero distribution list
 	short* coeffs = dct::colldata[ cmp ][ 0 ]; // Pointer to current coefficent data.
@@ -5139,11 +6669,12 @@ void pjg::decode::dc(const std::unique_ptr<aricoder>& dec, int cmp)
 		// r_y = h - ( p_y + 1 );
 		const int p_x = dpos % w;
 		const int r_x = w - ( p_x + 1 );
+		absv_store.advance( p_y );
 		
 		// get segment-number from zero distribution list and segmentation set
 		const int snum = segm_tab[ zdstls[dpos] ];
 		// calculate contexts (for bit length)
-		const int ctx_avr = pjg::aavrg_context( c_absc, c_weight, dpos, p_y, p_x, r_x ); // Average context
+		const int ctx_avr = pjg::aavrg_context( absv_store, c_weight, p_y, p_x, r_x ); // Average context
 		const int ctx_len = bitlen1024p( ctx_avr ); // Bitlength context				
 		// shift context / do context modelling (segmentation is done per context)
 		shift_model( mod_len, ctx_len, snum );
@@ -5171,7 +6702,7 @@ void pjg::decode::dc(const std::unique_ptr<aricoder>& dec, int cmp)
 			// copy to colldata
 			coeffs[ dpos ] = ( sgn == 0 ) ? absv : -absv;
 			// store absolute value/sign
-			absv_store[ dpos ] = absv;
+			absv_store.row( p_y )[ p_x ] = absv;
 		}
 	}
 	
@@ -5187,7 +6718,6 @@ void pjg::decode::dc(const std::unique_ptr<aricoder>& dec, int cmp)
 	----------------------------------------------- */
 void pjg::decode::ac_high(const std::unique_ptr<aricoder>& dec, int cmp)
 {	
-	unsigned short* c_absc[ 6 ]; // quick access array for contexts
 	int c_weight[ 6 ]; // weighting for contexts
 	
 	// decide segmentation setting
@@ -5202,15 +6732,11 @@ void pjg::decode::ac_high(const std::unique_ptr<aricoder>& dec, int cmp)
 	const int bc = cmpnfo[cmp].bc;
 	const int w = cmpnfo[cmp].bch;
 	
-	// allocate memory for absolute values & signs storage
-	std::vector<std::uint16_t> absv_store(bc); // absolute coefficients values storage
-	std::vector<std::uint8_t> sgn_store(bc); // sign storage for context	
+	// absolute values & signs storage, last three rows
+	pjg::RowRing<unsigned short> absv_store(w);
+	pjg::RowRing<unsigned char> sgn_store(w);
 	std::vector<std::uint8_t> zdstls(pjg::zdstdata[cmp], pjg::zdstdata[cmp] + bc); // copy of zero distribution list
 	
-	// set up quick access arrays for signs context
-	unsigned char* sgn_nbh = sgn_store.data() - 1; // Left signs neighbor.
-	unsigned char* sgn_nbv = sgn_store.data() - w; // Upper signs neighbor.
-	
 	// locally store pointer to eob x / eob y
 	unsigned char* eob_x = pjg::eobxhigh[ cmp ]; // Pointer to x eobs.
 	unsigned char* eob_y = pjg::eobyhigh[ cmp ]; // Pointer to y eobs.
@@ -5219,6 +6745,14 @@ void pjg::decode::ac_high(const std::unique_ptr<aricoder>& dec, int cmp)
 	std::fill(eob_x, eob_x + bc, static_cast<unsigned char>(0));
 	std::fill(eob_y, eob_y + bc, static_cast<unsigned char>(0));
 	
+	// sparse list of blocks with nonzeros left in the 7x7 bands, taken from the zero distribution list,
+	// blocks drop out once all their nonzeros are coded
+	std::vector<int> active;
+	active.reserve(bc);
+	for (int dpos = 0; dpos < bc; dpos++) {
+		if (zdstls[dpos] > 0) active.push_back(dpos);
+	}
+	
 	// work through lower 7x7 bands in order of pjg::freqscan
 	for (int i = 1; i < 64; i++ )
 	{		
@@ -5230,12 +6764,10 @@ void pjg::decode::ac_high(const std::unique_ptr<aricoder>& dec, int cmp)
 		if ( ( b_x == 0 ) || ( b_y == 0 ) )
 				continue; // process remaining coefficients elsewhere
 		
-		// preset absolute values/sign storage
-		std::fill(std::begin(absv_store), std::end(absv_store), static_cast<std::uint16_t>(0));
-		std::fill(std::begin(sgn_store), std::end(sgn_store), static_cast<std::uint8_t>(0));
-		
-		// set up average context quick access arrays
-		pjg::aavrg_prepare( c_absc, c_weight, absv_store.data(), cmp );
+		// set up average context weights, forget values of the previous band
+		pjg::aavrg_prepare( c_weight );
+		absv_store.reset();
+		sgn_store.reset();
 		
 		// locally store pointer to coefficients
 		short* coeffs = dct::colldata[ cmp ][ bpos ]; // Pointer to current coefficent data.
@@ -5244,22 +6776,20 @@ void pjg::decode::ac_high(const std::unique_ptr<aricoder>& dec, int cmp)
 		const int max_val = MAX_V( cmp, bpos ); // Max value.
 		const int max_len = bitlen1024p( max_val ); // Max bitlength.
 		
-		// arithmetic compression loop
-		for (int dpos = 0; dpos < bc; dpos++ )
+		// arithmetic compression loop, blocks beyond eob are not in the list
+		for (const int dpos : active)
 		{
-			// skip if beyound eob
-			if ( zdstls[dpos] == 0 )
-				continue;
-			
 			//calculate x/y positions in band
 			const int p_y = dpos / w;
 			const int p_x = dpos % w;
 			const int r_x = w - ( p_x + 1 );
+			absv_store.advance( p_y );
+			sgn_store.advance( p_y );
 			
 			// get segment-number from zero distribution list and segmentation set
 			const int snum = segm_tab[ zdstls[dpos] ];
 			// calculate contexts (for bit length)
-			const int ctx_avr = pjg::aavrg_context( c_absc, c_weight, dpos, p_y, p_x, r_x ); // Average context.
+			const int ctx_avr = pjg::aavrg_context( absv_store, c_weight, p_y, p_x, r_x ); // Average context.
 			const int ctx_len = bitlen1024p( ctx_avr ); // Bitlength context.
 			// shift context / do context modelling (segmentation is done per context)
 			shift_model( mod_len, ctx_len, snum );
@@ -5284,21 +6814,28 @@ void pjg::decode::ac_high(const std::unique_ptr<aricoder>& dec, int cmp)
 					if ( bt ) absv |= 1; 
 				}
 				// decode sign
-				int ctx_sgn = ( p_x > 0 ) ? sgn_nbh[ dpos ] : 0; // Sign context.
-				if ( p_y > 0 ) ctx_sgn += 3 * sgn_nbv[ dpos ]; // IMPROVE! !!!!!!!!!!!
+				int ctx_sgn = ( p_x > 0 ) ? sgn_store.row( p_y )[ p_x - 1 ] : 0; // Sign context.
+				if ( p_y > 0 ) ctx_sgn += 3 * sgn_store.row( p_y - 1 )[ p_x ]; // IMPROVE! !!!!!!!!!!!
 				mod_sgn->shift_context( ctx_sgn );
 				const int sgn = dec->decode_ari(mod_sgn );
 				// copy to colldata
 				coeffs[ dpos ] = ( sgn == 0 ) ? absv : -absv;
 				// store absolute value/sign, decrement zdst
-				absv_store[ dpos ] = absv;
-				sgn_store[ dpos ] = sgn + 1;
+				absv_store.row( p_y )[ p_x ] = absv;
+				sgn_store.row( p_y )[ p_x ] = sgn + 1;
 				zdstls[dpos]--;
 				// recalculate x/y eob
 				if ( b_x > eob_x[dpos] ) eob_x[dpos] = b_x;
 				if ( b_y > eob_y[dpos] ) eob_y[dpos] = b_y;	
 			}
 		}
+		// remove finished blocks from the list
+		std::size_t remaining = 0;
+		for (const int dpos : active) {
+			if (zdstls[dpos] > 0) active[remaining++] = dpos;
+		}
+		active.resize(remaining);
+		
 		// flush models
 		mod_len->flush_model();
 		mod_res->flush_model();
@@ -5448,7 +6985,7 @@ void pjg::decode::ac_low(const std::unique_ptr<aricoder>& dec, int cmp)
 /* -----------------------------------------------
 	deodes a stream of generic (8bit) data from pjg
 	----------------------------------------------- */
-bool pjg::decode::generic( const std::unique_ptr<aricoder>& dec, unsigned char** data, int* len )
+bool pjg::decode::generic( const std::unique_ptr<aricoder>& dec, unsigned char** data, std::size_t* len )
 {
 	// start byte writer
 	auto bwrt = std::make_unique<abytewriter>(1024);
@@ -5496,9 +7033,12 @@ std::vector<std::uint8_t> pjg::decode::generic(const std::unique_ptr<aricoder>&
 		return std::vector<std::uint8_t>();
 	}
 
-	auto data = bwrt->getptr();
-	auto length = bwrt->getpos();
-	return std::vector<std::uint8_t>(data, data + length);
+	std::vector<std::uint8_t> data;
+	data.reserve(bwrt->getpos());
+	bwrt->for_each_chunk([&data](const unsigned char* chunk, std::size_t size) {
+		data.insert(data.end(), chunk, chunk + size);
+	});
+	return data;
 
 }
 
@@ -5540,8 +7080,8 @@ void pjg::encode::get_zerosort_scan(unsigned char* sv, int cmpt)  {
 	std::copy(std::begin(index), std::end(index), sv);
 }
 
-void pjg::encode::optimize_dqt(int hpos, int segment_length) {
-	const int fpos = hpos + segment_length; // End of marker position.
+void pjg::encode::optimize_dqt(std::size_t hpos, int segment_length) {
+	const std::size_t fpos = hpos + segment_length; // End of marker position.
 	hpos += 4; // Skip marker and segment length data.
 	while (hpos < fpos) {
 		const int i = LBITS(hdrdata[hpos], 4);
@@ -5560,8 +7100,8 @@ void pjg::encode::optimize_dqt(int hpos, int segment_length) {
 	}
 }
 
-void pjg::encode::optimize_dht(int hpos, int segment_length) {
-	const int fpos = hpos + segment_length; // End of marker position.
+void pjg::encode::optimize_dht(std::size_t hpos, int segment_length) {
+	const std::size_t fpos = hpos + segment_length; // End of marker position.
 	hpos += 4; // Skip marker and segment length data.
 	while (hpos < fpos) {
 		hpos++;
@@ -5598,26 +7138,21 @@ void pjg::encode::optimize_dht(int hpos, int segment_length) {
 }
 
 void pjg::encode::optimize_header() {
-	int hpos = 0; // Current position in the header.
-
 	// Header parser loop:
-	while (hpos < hdrs) {
-		const std::uint8_t type = hdrdata[hpos + 1]; // Type of the current marker segment.
-		const int len = 2 + pack( hdrdata[ hpos + 2 ], hdrdata[ hpos + 3 ] ); // Length of the current marker segment.
-		if (type == 0xC4) { // DHT segment:
-			optimize_dht(hpos, len);
-		} else if (type == 0xDB) { // DQT segment:
-			optimize_dqt(hpos, len);
+	for (const auto& hseg : jpg::hdrsegs) {
+		if (hseg.type == 0xC4) { // DHT segment:
+			optimize_dht(hseg.pos, hseg.len);
+		} else if (hseg.type == 0xDB) { // DQT segment:
+			optimize_dqt(hseg.pos, hseg.len);
 		} else {
 			// Skip other segments.
 		}
-		hpos += len;
 	}
 }
 
 
-void pjg::decode::deoptimize_dqt(int hpos, int segment_length) {
-	int fpos = hpos + segment_length;
+void pjg::decode::deoptimize_dqt(std::size_t hpos, int segment_length) {
+	std::size_t fpos = hpos + segment_length;
 	hpos += 4; // Skip marker and segment length data.
 	while (hpos < fpos) {
 		const int i = LBITS( hdrdata[ hpos ], 4 );
@@ -5636,8 +7171,8 @@ void pjg::decode::deoptimize_dqt(int hpos, int segment_length) {
 	}
 }
 
-void pjg::decode::deoptimize_dht(int hpos, int segment_length) {
-	const int fpos = hpos + segment_length; // End of segment in hdrdata.
+void pjg::decode::deoptimize_dht(std::size_t hpos, int segment_length) {
+	const std::size_t fpos = hpos + segment_length; // End of segment in hdrdata.
 	hpos += 4; // Skip marker and segment length data.
 	while (hpos < fpos) {
 		hpos++;
@@ -5659,21 +7194,15 @@ void pjg::decode::deoptimize_dht(int hpos, int segment_length) {
 }
 
 void pjg::decode::deoptimize_header() {
-	int hpos = 0; // Current position in the header.
-
 	// Header parser loop:
-	while (hpos < hdrs) {
-		const std::uint8_t type = hdrdata[hpos + 1]; // Type of current marker segment.
-		const int len = 2 + pack( hdrdata[ hpos + 2 ], hdrdata[ hpos + 3 ] ); // Length of current marker segment.
-
-		if (type == 0xC4) { // DHT segment.
-			deoptimize_dht(hpos, len);
-		} else if (type == 0xDB) { // DQT segment.
-			deoptimize_dqt(hpos, len);
+	for (const auto& hseg : jpg::hdrsegs) {
+		if (hseg.type == 0xC4) { // DHT segment.
+			deoptimize_dht(hseg.pos, hseg.len);
+		} else if (hseg.type == 0xDB) { // DQT segment.
+			deoptimize_dqt(hseg.pos, hseg.len);
 		} else {
 			// Skip other segments.
 		}
-		hpos += len;
 	}
 }
 
@@ -5681,17 +7210,8 @@ void pjg::decode::deoptimize_header() {
 /* -----------------------------------------------
 	preparations for special average context
 	----------------------------------------------- */
-void pjg::aavrg_prepare( unsigned short** abs_coeffs, int* weights, unsigned short* abs_store, int cmp )
+void pjg::aavrg_prepare( int* weights )
 {
-	int w = cmpnfo[cmp].bch;
-	
-	// set up quick access arrays for all prediction positions
-	abs_coeffs[ 0 ] = abs_store + (  0 + ((-2)*w) ); // top-top
-	abs_coeffs[ 1 ] = abs_store + ( -1 + ((-1)*w) ); // top-left
-	abs_coeffs[ 2 ] = abs_store + (  0 + ((-1)*w) ); // top
-	abs_coeffs[ 3 ] = abs_store + (  1 + ((-1)*w) ); // top-right
-	abs_coeffs[ 4 ] = abs_store + ( -2 + (( 0)*w) ); // left-left
-	abs_coeffs[ 5 ] = abs_store + ( -1 + (( 0)*w) ); // left
 	// copy context weighting factors
 	weights[ 0 ] = abs_ctx_weights_lum[ 0 ][ 0 ][ 2 ]; // top-top
 	weights[ 1 ] = abs_ctx_weights_lum[ 0 ][ 1 ][ 1 ]; // top-left
@@ -5705,52 +7225,56 @@ void pjg::aavrg_prepare( unsigned short** abs_coeffs, int* weights, unsigned sho
 /* -----------------------------------------------
 	special average context used in coeff encoding
 	----------------------------------------------- */
-int pjg::aavrg_context( unsigned short** abs_coeffs, int* weights, int pos, int p_y, int p_x, int r_x )
+int pjg::aavrg_context( RowRing<unsigned short>& absv, const int* weights, int p_y, int p_x, int r_x )
 {
 	int ctx_avr = 0; // AVERAGE context
 	int w_ctx = 0; // accumulated weight of context
 	int w_curr; // current weight of context
 	
+	// rows around the current position
+	const unsigned short* curr = absv.row( p_y ) + p_x; // current row
+	const unsigned short* top = absv.row( p_y - 1 ) + p_x; // row above
+	const unsigned short* toptop = absv.row( p_y - 2 ) + p_x; // two rows above
 	
 	// different cases due to edge treatment
 	if ( p_y >= 2 ) {
-		w_curr = weights[ 0 ]; ctx_avr += abs_coeffs[ 0 ][ pos ] * w_curr; w_ctx += w_curr;
-		w_curr = weights[ 2 ]; ctx_avr += abs_coeffs[ 2 ][ pos ] * w_curr; w_ctx += w_curr;
+		w_curr = weights[ 0 ]; ctx_avr += toptop[ 0 ] * w_curr; w_ctx += w_curr;
+		w_curr = weights[ 2 ]; ctx_avr += top[ 0 ] * w_curr; w_ctx += w_curr;
 		if ( p_x >= 2 ) {
-			w_curr = weights[ 1 ]; ctx_avr += abs_coeffs[ 1 ][ pos ] * w_curr; w_ctx += w_curr;
-			w_curr = weights[ 4 ]; ctx_avr += abs_coeffs[ 4 ][ pos ] * w_curr; w_ctx += w_curr;
-			w_curr = weights[ 5 ]; ctx_avr += abs_coeffs[ 5 ][ pos ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 1 ]; ctx_avr += top[ -1 ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 4 ]; ctx_avr += curr[ -2 ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 5 ]; ctx_avr += curr[ -1 ] * w_curr; w_ctx += w_curr;
 		}
 		else if ( p_x == 1 ) {
-			w_curr = weights[ 1 ]; ctx_avr += abs_coeffs[ 1 ][ pos ] * w_curr; w_ctx += w_curr;
-			w_curr = weights[ 5 ]; ctx_avr += abs_coeffs[ 5 ][ pos ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 1 ]; ctx_avr += top[ -1 ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 5 ]; ctx_avr += curr[ -1 ] * w_curr; w_ctx += w_curr;
 		}
 		if ( r_x >= 1 ) {
-			w_curr = weights[ 3 ]; ctx_avr += abs_coeffs[ 3 ][ pos ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 3 ]; ctx_avr += top[ 1 ] * w_curr; w_ctx += w_curr;
 		}
 	}
 	else if ( p_y == 1 ) {
-		w_curr = weights[ 2 ]; ctx_avr += abs_coeffs[ 2 ][ pos ] * w_curr; w_ctx += w_curr;
+		w_curr = weights[ 2 ]; ctx_avr += top[ 0 ] * w_curr; w_ctx += w_curr;
 		if ( p_x >= 2 ) {
-			w_curr = weights[ 1 ]; ctx_avr += abs_coeffs[ 1 ][ pos ] * w_curr; w_ctx += w_curr;
-			w_curr = weights[ 4 ]; ctx_avr += abs_coeffs[ 4 ][ pos ] * w_curr; w_ctx += w_curr;
-			w_curr = weights[ 5 ]; ctx_avr += abs_coeffs[ 5 ][ pos ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 1 ]; ctx_avr += top[ -1 ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 4 ]; ctx_avr += curr[ -2 ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 5 ]; ctx_avr += curr[ -1 ] * w_curr; w_ctx += w_curr;
 		}
 		else if ( p_x == 1 ) {
-			w_curr = weights[ 1 ]; ctx_avr += abs_coeffs[ 1 ][ pos ] * w_curr; w_ctx += w_curr;
-			w_curr = weights[ 5 ]; ctx_avr += abs_coeffs[ 5 ][ pos ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 1 ]; ctx_avr += top[ -1 ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 5 ]; ctx_avr += curr[ -1 ] * w_curr; w_ctx += w_curr;
 		}
 		if ( r_x >= 1 ) {
-			w_curr = weights[ 3 ]; ctx_avr += abs_coeffs[ 3 ][ pos ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 3 ]; ctx_avr += top[ 1 ] * w_curr; w_ctx += w_curr;
 		}
 	}
 	else {
 		if ( p_x >= 2 ) {
-			w_curr = weights[ 4 ]; ctx_avr += abs_coeffs[ 4 ][ pos ] * w_curr; w_ctx += w_curr;
-			w_curr = weights[ 5 ]; ctx_avr += abs_coeffs[ 5 ][ pos ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 4 ]; ctx_avr += curr[ -2 ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 5 ]; ctx_avr += curr[ -1 ] * w_curr; w_ctx += w_curr;
 		}
 		else if ( p_x == 1 ) {
-			w_curr = weights[ 5 ]; ctx_avr += abs_coeffs[ 5 ][ pos ] * w_curr; w_ctx += w_curr;
+			w_curr = weights[ 5 ]; ctx_avr += curr[ -1 ] * w_curr; w_ctx += w_curr;
 		}
 	}
 	
@@ -6095,7 +7619,7 @@ static bool file_exists(const std::string& filename) {
 #if !defined(BUILD_LIB) && defined(DEV_BUILD)
 static bool dump_hdr() {
 	const std::string ext = "hdr";
-	const auto basename = filelist[file_no];
+	const auto basename = files::curr;
 
 	if (!dump_file(basename, ext, hdrdata, 1, hdrs)) {
 		return false;
@@ -6109,7 +7633,7 @@ static bool dump_hdr() {
 	----------------------------------------------- */
 static bool dump_huf() {
 	const std::string ext = "huf";
-	const auto basename = filelist[file_no];
+	const auto basename = files::curr;
 
 	if (!dump_file(basename, ext, huffdata.data(), 1, huffdata.size())) {
 		return false;
@@ -6124,7 +7648,7 @@ static bool dump_huf() {
 static bool dump_coll()
 {
 	const std::array<std::string, 4> ext = { "coll0", "coll1", "coll2", "coll3" };
-	const auto& base = filelist[file_no];
+	const auto& base = files::curr;
 
 	for (int cmp = 0; cmp < image::cmpc; cmp++) {
 		// create filename
@@ -6221,7 +7745,7 @@ static bool dump_coll()
 	----------------------------------------------- */
 static bool dump_zdst() {
 	const std::array<std::string, 4> ext = { "zdst0", "zdst1", "zdst2", "zdst3" };
-	const auto basename = filelist[file_no];
+	const auto basename = files::curr;
 
 	for (int cmp = 0; cmp < image::cmpc; cmp++) {
 		if (!dump_file(basename, ext[cmp], pjg::zdstdata[cmp], 1, cmpnfo[cmp].bc)) {
@@ -6235,7 +7759,7 @@ static bool dump_zdst() {
 /* -----------------------------------------------
 	Writes to file
 	----------------------------------------------- */
-static bool dump_file(const std::string& base, const std::string& ext, void* data, int bpv, int size) {
+static bool dump_file(const std::string& base, const std::string& ext, void* data, int bpv, std::size_t size) {
 	// create filename
 	const auto fn = create_filename(base, ext);
 
@@ -6266,9 +7790,9 @@ static bool dump_errfile() {
 	// create filename based on errorlevel
 	std::string fn;
 	if (errorlevel == 1) {
-		fn = create_filename(filelist[file_no], "wrn.nfo");
+		fn = create_filename(files::curr, "wrn.nfo");
 	} else {
-		fn = create_filename(filelist[file_no], "err.nfo");
+		fn = create_filename(files::curr, "err.nfo");
 	}
 
 	// open file for output
@@ -6280,7 +7804,7 @@ static bool dump_errfile() {
 	}
 
 	// write status and errormessage to file
-	fprintf(fp, "--> error (level %i) in file \"%s\" <--\n", errorlevel, filelist[file_no].c_str());
+	fprintf(fp, "--> error (level %i) in file \"%s\" <--\n", errorlevel, files::curr.c_str());
 	fprintf(fp, "\n");
 	// write error specification to file
 	fprintf(fp, " %s -> %s:\n", get_status(errorfunction).c_str(),
@@ -6298,7 +7822,7 @@ static bool dump_errfile() {
 	----------------------------------------------- */
 static bool dump_info() {
 	// create filename
-	const auto fn = create_filename(filelist[file_no], "nfo");
+	const auto fn = create_filename(files::curr, "nfo");
 
 	// open file for output
 	FILE* fp = fopen(fn.c_str(), "w");
@@ -6320,14 +7844,14 @@ static bool dump_info() {
 	fprintf(fp, "\nfile header structure:\n");
 	fprintf(fp, " type  length   hpos\n");
 	// header parser loop
-	int hpos; // Position in the header.
+	std::size_t hpos; // Position in the header.
 	int len = 0; // Length of current marker segment.
 	for (hpos = 0; hpos < hdrs; hpos += len) {
 		std::uint8_t type = hdrdata[hpos + 1]; // Type of current marker segment.
 		len = 2 + pack(hdrdata[hpos + 2], hdrdata[hpos + 3]);
-		fprintf(fp, " FF%2X  %6i %6i\n", (int)type, len, hpos);
+		fprintf(fp, " FF%2X  %6i %6i\n", (int)type, len, (int)hpos);
 	}
-	fprintf(fp, " _END       0 %6i\n", hpos);
+	fprintf(fp, " _END       0 %6i\n", (int)hpos);
 	fprintf(fp, "\n");
 
 	// info about compression settings	
@@ -6378,7 +7902,7 @@ static bool dump_info() {
 	----------------------------------------------- */
 static bool dump_dist() {
 	// create filename
-	const auto fn = create_filename(filelist[file_no], "dist");
+	const auto fn = create_filename(files::curr, "dist");
 
 	// open file for output
 	FILE* fp = fopen(fn.c_str(), "wb");
@@ -6415,7 +7939,7 @@ static bool dump_pgm() {
 
 	for (int cmp = 0; cmp < image::cmpc; cmp++) {
 		// create filename
-		const auto fn = create_filename(filelist[file_no], ext[cmp]);
+		const auto fn = create_filename(files::curr, ext[cmp]);
 
 		// open file for output
 		FILE* fp = fopen(fn.c_str(), "wb");
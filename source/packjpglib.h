@@ -1,6 +1,8 @@
 #ifndef PACKJPGLIB_H
 #define PACKJPGLIB_H
 
+#include <cstddef>
+
 // packJPGlib.h - function declarations for the packJPG library
 #if defined BUILD_DLL
 	#define EXPORT __declspec( dllexport )
@@ -8,6 +10,19 @@
 	#define EXPORT extern
 #endif
 
+/* -----------------------------------------------
+	user functions for in-/output type 3, read returns
+	the number of bytes read (0 at the end of the data),
+	write returns the number of bytes written (anything
+	short of size fails the conversion)
+	----------------------------------------------- */
+
+struct pjglib_callbacks {
+	std::size_t ( *read )( void* opaque, unsigned char* buf, std::size_t size );
+	std::size_t ( *write )( void* opaque, const unsigned char* buf, std::size_t size );
+	void* opaque;
+};
+
 /* -----------------------------------------------
 	function declarations: library only functions
 	----------------------------------------------- */
@@ -15,10 +30,50 @@
 EXPORT bool pjglib_convert_stream2stream( char* msg );
 EXPORT bool pjglib_convert_file2file( char* in, char* out, char* msg );
 EXPORT bool pjglib_convert_stream2mem( unsigned char** out_file, unsigned int* out_size, char* msg );
+EXPORT bool pjglib_convert_stream2mem64( unsigned char** out_file, std::size_t* out_size, char* msg );
 EXPORT void pjglib_init_streams( void* in_src, int in_type, int in_size, void* out_dest, int out_type );
+EXPORT void pjglib_init_streams64( void* in_src, int in_type, std::size_t in_size, void* out_dest, int out_type );
 EXPORT const char* pjglib_version_info();
 EXPORT const char* pjglib_short_name();
 
+/* -----------------------------------------------
+	conversion fed in portions (link with -pthread)
+	
+	pjglib_feed() queues input and never blocks.
+	The input is converted on a worker thread.
+	
+	pjglib_read_output() returns the next output portion.
+	A portion is valid until the next call.
+	It waits while the conversion runs and returns
+	PJGLIB_NEED_MORE_INPUT once the conversion waits
+	for input.
+	
+	pjglib_finish() ends the input and waits for the
+	conversion. Output left then is read as before.
+	If it fails, all output read is to be discarded.
+	
+	Only one conversion runs at a time. While one runs,
+	pjglib_feed() of another context and the other
+	conversion functions fail. A context runs from its
+	first pjglib_feed() until its conversion ends, at
+	the latest when pjglib_finish() returns.
+	----------------------------------------------- */
+
+struct pjglib_ctx;
+
+enum pjglib_status {
+	PJGLIB_ERROR = -1,
+	PJGLIB_NEED_MORE_INPUT = 0,
+	PJGLIB_OUTPUT = 1,
+	PJGLIB_DONE = 2
+};
+
+EXPORT pjglib_ctx* pjglib_ctx_new();
+EXPORT int pjglib_feed( pjglib_ctx* ctx, const unsigned char* data, std::size_t size );
+EXPORT int pjglib_finish( pjglib_ctx* ctx, char* msg );
+EXPORT int pjglib_read_output( pjglib_ctx* ctx, const unsigned char** chunk, std::size_t* size );
+EXPORT void pjglib_ctx_free( pjglib_ctx* ctx );
+
 /* a short reminder about input/output stream types
    for the pjglib_init_streams() function
 	
@@ -32,7 +87,8 @@ EXPORT const char* pjglib_short_name();
 	------------------
 	in_scr -> array containg data
 	in_type -> 1
-	in_size -> size of data array
+	in_size -> size of data array (use the ...64() functions
+	           for data of 2GB and more)
 	
 	if input is *FILE (f.e. stdin)
 	------------------------------
@@ -40,6 +96,13 @@ EXPORT const char* pjglib_short_name();
 	in_type -> 2
 	in_size -> ignore
 	
+	if input is read through callbacks
+	---------------------------------
+	in_src -> pointer to pjglib_callbacks (read and opaque
+	          are used, copied by the call)
+	in_type -> 3
+	in_size -> ignore
+	
 	vice versa for output streams! */
 
 #endif
\ No newline at end of file